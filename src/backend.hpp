@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+// Interfaces used by the machine to talk to the outside world. The SDL
+// frontend implements them, headless tools use the null implementations.
+
+class VideoBackend
+{
+public:
+    virtual ~VideoBackend() = default;
+
+    // Called with the display rows when they changed since the last call, one
+    // bit per pixel with the leftmost pixel in the most significant bit.
+    // Bit n of dirty_rows is set when row n changed.
+    virtual void update_display(const uint64_t* display, uint32_t dirty_rows) = 0;
+};
+
+class AudioBackend
+{
+public:
+    virtual ~AudioBackend() = default;
+
+    // Called on every timer tick with the machine cycle of the tick, enabled
+    // while the sound timer is active
+    virtual void set_sound(bool enabled, uint64_t cycle) = 0;
+};
+
+class InputBackend
+{
+public:
+    virtual ~InputBackend() = default;
+
+    // Key is a CHIP-8 key index in range [0x0, 0xF]
+    virtual bool is_key_pressed(uint8_t key) = 0;
+};
+
+class NullVideoBackend final : public VideoBackend
+{
+public:
+    void update_display(const uint64_t* display, uint32_t dirty_rows) override { (void)display; (void)dirty_rows; }
+};
+
+class NullAudioBackend final : public AudioBackend
+{
+public:
+    void set_sound(bool enabled, uint64_t cycle) override { (void)enabled; (void)cycle; }
+};
+
+class NullInputBackend final : public InputBackend
+{
+public:
+    bool is_key_pressed(uint8_t key) override { (void)key; return false; }
+};
@@ -0,0 +1,117 @@
+#include "beeper.hpp"
+#include <cmath>
+
+Beeper::Beeper(uint32_t sample_rate)
+    : m_sample_rate(sample_rate)
+{
+    m_phase_step = static_cast<uint32_t>((static_cast<uint64_t>(ToneFrequency) << 32) / sample_rate);
+
+    // Odd harmonics of the square wave up to the Nyquist frequency
+    constexpr double Volume = 0.25;
+    const double pi = std::acos(-1.0);
+    const uint32_t harmonics = sample_rate / 2 / ToneFrequency;
+    for (uint32_t index = 0; index < TableSize; index++)
+    {
+        const double x = 2.0 * pi * index / TableSize;
+        double value = 0.0;
+        for (uint32_t harmonic = 1; harmonic <= harmonics; harmonic += 2)
+            value += std::sin(harmonic * x) / harmonic;
+        m_table[index] = static_cast<int16_t>(value * 4.0 / pi * Volume * 32767.0);
+    }
+}
+
+void Beeper::set_latency(uint32_t latency)
+{
+    m_latency = latency;
+    m_synced = false;
+    m_scheduled_count = 0;
+}
+
+void Beeper::set_sound(bool enabled, uint64_t cycle, uint32_t instructions_per_second)
+{
+    // Emulated samples follow the cycles, a loaded state or a long pause starts
+    // counting again from the current sample
+    uint64_t elapsed = cycle > m_cycle ? cycle - m_cycle : 0;
+    if (elapsed > instructions_per_second)
+        elapsed = 0;
+    m_cycle = cycle;
+
+    const uint64_t total = elapsed * m_sample_rate + m_sample_remainder;
+    m_sample += total / instructions_per_second;
+    m_sample_remainder = total % instructions_per_second;
+
+    if (enabled == m_enabled)
+        return;
+
+    // A full queue keeps the old state, the change is sent again on the next tick
+    Event event;
+    event.sample = m_sample;
+    event.enabled = enabled;
+    if (m_events.push(event))
+        m_enabled = enabled;
+}
+
+// Schedules the changes sent since the last callback. The first change, and
+// one that arrives late or too far ahead after a stall or fast-forward, maps
+// the emulated time again so that it plays a latency from now.
+void Beeper::receive_events()
+{
+    Event event;
+    while (m_scheduled_count < EventCapacity && m_events.pop(event))
+    {
+        int64_t at = static_cast<int64_t>(event.sample) + m_offset;
+        const int64_t played = static_cast<int64_t>(m_played);
+        if (!m_synced || at < played || at > played + 4 * static_cast<int64_t>(m_latency))
+        {
+            if (m_synced)
+            {
+                if (at < played)
+                    m_late_events.fetch_add(1, std::memory_order_relaxed);
+                m_resyncs.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            m_offset = played + m_latency - static_cast<int64_t>(event.sample);
+            at = played + m_latency;
+            m_synced = true;
+        }
+
+        // Changes keep their order when the mapping moves back
+        if (m_scheduled_count > 0)
+        {
+            const Event& last = m_scheduled[(m_scheduled_head + m_scheduled_count - 1) % EventCapacity];
+            if (at < static_cast<int64_t>(last.sample))
+                at = static_cast<int64_t>(last.sample);
+        }
+
+        event.sample = static_cast<uint64_t>(at);
+        m_scheduled[(m_scheduled_head + m_scheduled_count) % EventCapacity] = event;
+        m_scheduled_count++;
+    }
+}
+
+void Beeper::render(int16_t* output, uint32_t count, uint32_t channels)
+{
+    receive_events();
+
+    for (uint32_t index = 0; index < count; index++)
+    {
+        while (m_scheduled_count > 0 && m_scheduled[m_scheduled_head].sample <= m_played)
+        {
+            m_playing = m_scheduled[m_scheduled_head].enabled;
+            m_scheduled_head = (m_scheduled_head + 1) % EventCapacity;
+            m_scheduled_count--;
+        }
+
+        if (m_playing && m_gain < RampSamples)
+            m_gain++;
+        else if (!m_playing && m_gain > 0)
+            m_gain--;
+
+        const int32_t value = m_table[m_phase >> 22] * static_cast<int32_t>(m_gain) / static_cast<int32_t>(RampSamples);
+        m_phase += m_phase_step;
+        m_played++;
+
+        for (uint32_t channel = 0; channel < channels; channel++)
+            *output++ = static_cast<int16_t>(value);
+    }
+}
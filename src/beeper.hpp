@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "spsc_queue.hpp"
+
+// Tone played while the sound timer runs. The emulation thread reports the
+// sound state on every timer tick with the machine cycle, only the changes go
+// to the audio thread, stamped with the emulated sample they happen at. The
+// audio thread plays each change at its sample, a fixed latency after the
+// emulated time, from a band-limited square wave table.
+class Beeper
+{
+public:
+    static inline constexpr uint32_t ToneFrequency = 800;
+    static inline constexpr uint32_t TableSize = 1024;
+    static inline constexpr uint32_t RampSamples = 32; // Fade in and out, no clicks
+    static inline constexpr uint32_t EventCapacity = 256;
+    static inline constexpr uint32_t DefaultSampleRate = 44100;
+
+    explicit Beeper(uint32_t sample_rate = DefaultSampleRate);
+
+    uint32_t sample_rate() const { return m_sample_rate; }
+
+    // Samples between the emulated time of a change and when it plays, call
+    // while the audio thread does not render
+    void set_latency(uint32_t latency);
+    uint32_t latency() const { return m_latency; }
+
+    // Emulation thread, on every timer tick
+    void set_sound(bool enabled, uint64_t cycle, uint32_t instructions_per_second);
+
+    // Audio thread, writes count samples to every channel
+    void render(int16_t* output, uint32_t count, uint32_t channels);
+
+    // Changes that reached the audio thread after their time, and times the
+    // emulated time was mapped again to the played samples
+    uint32_t late_events() const { return m_late_events.load(std::memory_order_relaxed); }
+    uint32_t resyncs() const { return m_resyncs.load(std::memory_order_relaxed); }
+
+private:
+    // Emulated sample of a change when sent, played sample once received
+    struct Event
+    {
+        uint64_t sample = 0;
+        bool enabled = false;
+    };
+
+    uint32_t m_sample_rate = DefaultSampleRate;
+    uint32_t m_latency = 1024;
+    uint32_t m_phase_step = 0;
+    int16_t m_table[TableSize] = { 0 };
+
+    SpscQueue<Event, EventCapacity> m_events;
+
+    // Emulation thread
+    bool m_enabled = false;
+    uint64_t m_cycle = 0;
+    uint64_t m_sample = 0;
+    uint64_t m_sample_remainder = 0;
+
+    // Audio thread
+    uint64_t m_played = 0;
+    int64_t m_offset = 0;
+    bool m_synced = false;
+    Event m_scheduled[EventCapacity];
+    uint32_t m_scheduled_head = 0;
+    uint32_t m_scheduled_count = 0;
+    bool m_playing = false;
+    uint32_t m_phase = 0;
+    uint32_t m_gain = 0;
+
+    std::atomic<uint32_t> m_late_events { 0 };
+    std::atomic<uint32_t> m_resyncs { 0 };
+
+    void receive_events();
+};
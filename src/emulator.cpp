@@ -7,30 +7,14 @@
 #include "utils.hpp"
 #include "platform.hpp"
 #include "version.hpp"
+#include <chrono>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <random>
 #include <thread>
-
-// Font data
-uint8_t Emulator::m_font[Emulator::FontSize] = {
-    0xF0, 0x90, 0x90, 0x90, 0xF0,
-    0x20, 0x60, 0x20, 0x20, 0x70,
-    0xF0, 0x10, 0xF0, 0x80, 0xF0,
-    0xF0, 0x10, 0xF0, 0x10, 0xF0,
-    0x90, 0x90, 0xF0, 0x10, 0x10,
-    0xF0, 0x80, 0xF0, 0x10, 0xF0,
-    0xF0, 0x80, 0xF0, 0x90, 0xF0,
-    0xF0, 0x10, 0x20, 0x40, 0x40,
-    0xF0, 0x90, 0xF0, 0x90, 0xF0,
-    0xF0, 0x90, 0xF0, 0x10, 0xF0,
-    0xF0, 0x90, 0xF0, 0x90, 0x90,
-    0xE0, 0x90, 0xE0, 0x90, 0xE0,
-    0xF0, 0x80, 0x80, 0x80, 0xF0,
-    0xE0, 0x90, 0x90, 0x90, 0xE0,
-    0xF0, 0x80, 0xF0, 0x80, 0xF0,
-    0xF0, 0x80, 0xF0, 0x80, 0x80
-};
+#include <utility>
+#include <vector>
 
 // Keys map
 int Emulator::m_keymap[Emulator::KeyCount] = {
@@ -40,8 +24,32 @@ int Emulator::m_keymap[Emulator::KeyCount] = {
     SDL_SCANCODE_Z, SDL_SCANCODE_X, SDL_SCANCODE_C, SDL_SCANCODE_V
 };
 
+// Color picker for an ARGB palette color, true when it changed
+static bool edit_color(const char* label, uint32_t& color)
+{
+    float rgb[3] = {
+        ((color >> 16) & 0xFF) / 255.0f,
+        ((color >> 8) & 0xFF) / 255.0f,
+        (color & 0xFF) / 255.0f,
+    };
+
+    if (!ImGui::ColorEdit3(label, rgb))
+        return false;
+
+    color = 0xFF000000;
+    for (int index = 0; index < 3; index++)
+        color |= static_cast<uint32_t>(rgb[index] * 255.0f + 0.5f) << (16 - index * 8);
+    return true;
+}
+
 Emulator::~Emulator()
 {
+    if (m_emulation_thread.joinable())
+    {
+        m_quit.store(true, std::memory_order_release);
+        m_emulation_thread.join();
+    }
+
     delete m_memory_window;
 
     ImGui_ImplSDLRenderer2_Shutdown();
@@ -75,13 +83,17 @@ bool Emulator::init()
         return false;
     }
 
-    m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_ACCELERATED);
+    m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_ACCELERATED | (m_vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
     if (!m_renderer)
     {
         logger::error("SDL_CreateRenderer error: %s", SDL_GetError());
         return false;
     }
 
+    SDL_DisplayMode display_mode {};
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(m_window), &display_mode) == 0 && display_mode.refresh_rate > 0)
+        m_refresh_rate = display_mode.refresh_rate;
+
     m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, DisplayWidth, DisplayHeight);
     if (!m_texture)
     {
@@ -89,31 +101,8 @@ bool Emulator::init()
         return false;
     }
 
-    // Init audio
-    SDL_AudioSpec audio_spec;
-    audio_spec.freq     = 44100;
-    audio_spec.format   = AUDIO_S16;
-    audio_spec.channels = 1;
-    audio_spec.samples  = audio_spec.freq / 20;
-    audio_spec.userdata = this;
-
-    audio_spec.callback = [](void *user_data, unsigned char *stream, int size)
-    {
-        Emulator *emu = static_cast<Emulator*>(user_data);
-        for (int sample = 0; sample < emu->m_audio_spec.samples; sample++)
-        {
-            double data = emu->get_audio_sample();
-
-            for (int channel = 0; channel < emu->m_audio_spec.channels; channel++)
-            {
-                int offset = (sample * sizeof(int16_t) * emu->m_audio_spec.channels) + (channel * sizeof(int16_t));
-                uint8_t* buffer = stream + offset;
-                emu->write_audio_data(buffer, data);
-            }
-        }
-    };
-
-    m_audio_device = SDL_OpenAudioDevice(nullptr, 0, &audio_spec, &m_audio_spec, 0);
+    // Without an audio device the emulator runs silent
+    open_audio(m_audio_buffer);
 
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -132,45 +121,350 @@ bool Emulator::init()
     m_memory_window = new MemoryEditor();
     m_memory_window->Open = false;
 
+    m_machine.set_video(this);
+    m_machine.set_audio(this);
+    m_machine.set_input(this);
+
     return true;
 }
 
 void Emulator::run(int argc, char* argv[])
 {
-    constexpr auto TIMER = 60; // hz
-    constexpr auto DELAY = 1000.0f / TIMER;
+    using clock = std::chrono::steady_clock;
+
+    // chip8 [--quirks modern|vip|schip|xochip] rom_file
+    int rom_arg = 1;
+    if (argc > 2 && std::strcmp(argv[1], "--quirks") == 0)
+    {
+        QuirkProfile profile;
+        if (quirks::from_name(argv[2], profile))
+            send(Command::Type::SetQuirks, static_cast<int>(profile));
+        else
+            logger::error("Unknown quirk profile %s", argv[2]);
+        rom_arg = 3;
+    }
+
+    if (argc > rom_arg)
+        send(Command::Type::LoadRom, 0, 0, argv[rom_arg]);
 
-    uint32_t frame_start = SDL_GetTicks();
-    uint32_t frame_time = 0;
+    // The machine runs on its own thread, a slow present or a file dialog
+    // here doesn't hold it up
+    m_emulation_thread = std::thread(&Emulator::emulation_loop, this);
 
-    if (argc > 1)
-        load_rom_from_file(argv[1]);
+    // Presents follow the display refresh with vsync or the target frame rate
+    // without it, each shows the newest frame of the emulation thread
+    auto present_deadline = clock::now();
 
     while (!m_exit)
     {
         handle_input();
-        if (m_rom_loaded && !m_paused)
+        take_frame();
+
+        // With vsync SDL_RenderPresent waits for the display refresh
+        render();
+
+        // Without vsync sleep until the next present
+        const auto present_interval = std::chrono::microseconds(1000000 / (m_vsync ? m_refresh_rate : m_target_fps));
+        const auto now = clock::now();
+        present_deadline += present_interval;
+        if (present_deadline < now || m_vsync)
+            present_deadline = now;
+        else
+            platform::sleep_until(present_deadline);
+    }
+
+    m_quit.store(true, std::memory_order_release);
+    m_emulation_thread.join();
+}
+
+bool Emulator::send(Command::Type type, int value, int argument, std::string path)
+{
+    Command command;
+    command.type = type;
+    command.value = value;
+    command.argument = argument;
+    command.path = std::move(path);
+
+    if (m_commands.push(std::move(command)))
+        return true;
+
+    logger::warning("Emulation command queue is full");
+    return false;
+}
+
+// Takes the newest frame of the emulation thread, the rows that differ from
+// the presented ones are expanded to the texture again
+void Emulator::take_frame()
+{
+    if (m_frames.update())
+    {
+        const Frame& latest = frame();
+        for (uint32_t row = 0; row < DisplayHeight; row++)
         {
-            execute_next_instruction();
+            if (latest.display[row] != m_display[row])
+            {
+                m_display[row] = latest.display[row];
+                m_texture_dirty_rows |= 1u << row;
+            }
+        }
+    }
 
-            if (m_display_updated)
-                update_color_buffer();
+    const uint64_t frame_count = frame().status.frame_count;
+    m_frames_per_present += ((double)(frame_count - m_presented_frame_count) - m_frames_per_present) * 0.05;
+    m_presented_frame_count = frame_count;
+}
 
-            frame_time = SDL_GetTicks() - frame_start;
-            if (frame_time >= DELAY)
+// Emulated frames are due on their own 60 Hz schedule. Commands are taken
+// once per pass and a frame is handed to the user interface when anything
+// changed.
+void Emulator::emulation_loop()
+{
+    using clock = std::chrono::steady_clock;
+    constexpr auto FRAME_DURATION = std::chrono::microseconds(1000000 / FrameRate);
+    constexpr auto MAX_EMULATION_LAG = std::chrono::milliseconds(100);
+
+    auto deadline = clock::now();
+    auto speed_start = clock::now();
+
+    while (!m_quit.load(std::memory_order_acquire))
+    {
+        const bool changed = handle_commands();
+
+        const auto start = clock::now();
+        const bool running = m_status.rom_loaded && !m_status.paused;
+        const bool fast_forward = m_status.turbo || (m_input & InputFastForward) != 0;
+        const bool rewinding = m_status.rewind_enabled && (m_input & InputRewind) != 0;
+        uint32_t frames = 0;
+
+        // Nothing sounds while the machine stands still or steps back
+        if (!running || rewinding)
+            set_sound(false, m_machine.cycles());
+
+        if (running && fast_forward && !rewinding)
+        {
+            // Emulate frames until the next frame is handed over, the timers
+            // follow the virtual clock so games keep their speed relative to it
+            const auto publish_deadline = start + FRAME_DURATION;
+            do
             {
-                update_timers();
-                frame_start = SDL_GetTicks();
+                emulate_frame();
+                frames++;
             }
+            while (clock::now() < publish_deadline);
+
+            // One rewind snapshot per handed over frame
+            if (m_status.rewind_enabled)
+                m_rewind.push(m_machine);
+
+            deadline = clock::now();
         }
+        else if (running)
+        {
+            // Run the frames due, holding Backspace steps back one frame
+            // instead. Don't try to catch up after a stall.
+            if (start - deadline > MAX_EMULATION_LAG)
+                deadline = start;
 
-        render();
+            for (; deadline <= start; deadline += FRAME_DURATION)
+            {
+                if (rewinding)
+                {
+                    stop_recording();
+                    m_rewind.rewind(m_machine);
+                }
+                else
+                {
+                    emulate_frame();
+                    if (m_status.rewind_enabled)
+                        m_rewind.push(m_machine);
+                }
+                frames++;
+            }
+        }
+        else
+        {
+            deadline = start + FRAME_DURATION;
+        }
+
+        if (frames > 0)
+        {
+            auto run_ahead_start = clock::now();
+            if (m_status.run_ahead_frames > 0 && !rewinding && !fast_forward)
+                run_ahead();
+            else
+                m_machine.present();
+
+            auto end = clock::now();
+            auto smooth = [](double& average, double value) { average += (value - average) * 0.05; };
+            smooth(m_status.emulation_time, std::chrono::duration<double, std::milli>(run_ahead_start - start).count() / frames);
+            smooth(m_status.run_ahead_time, std::chrono::duration<double, std::milli>(end - run_ahead_start).count());
+            m_status.frame_count += frames;
+        }
+        else if (changed)
+        {
+            // Reset, state loads and memory edits show without running a frame
+            m_machine.present();
+        }
+
+        // Emulated frames per wall clock frame, over half a second
+        auto now = clock::now();
+        if (now - speed_start >= std::chrono::milliseconds(500))
+        {
+            m_status.speed = m_speed_frames / (std::chrono::duration<double>(now - speed_start).count() * FrameRate);
+            m_speed_frames = 0;
+            speed_start = now;
+        }
+
+        if (frames > 0 || changed)
+            publish_frame();
+
+        // Fast-forward runs on, otherwise sleep to the next frame on an
+        // absolute deadline so wake up delays don't add up
+        if (!(running && fast_forward && !rewinding))
+            platform::sleep_until(deadline);
+    }
+}
+
+bool Emulator::handle_commands()
+{
+    bool handled = false;
+
+    Command command;
+    while (m_commands.pop(command))
+    {
+        handled = true;
+
+        switch (command.type)
+        {
+        case Command::Type::Input:
+            m_input = command.value;
+            break;
+
+        case Command::Type::LoadRom:
+            load_rom_from_file(command.path);
+            break;
+
+        case Command::Type::Reset:
+            reset();
+            break;
+
+        case Command::Type::Stop:
+            stop();
+            break;
+
+        case Command::Type::SetPaused:
+            m_status.paused = command.value != 0;
+            break;
+
+        case Command::Type::SetTurbo:
+            m_status.turbo = command.value != 0;
+            break;
+
+        case Command::Type::SetRewind:
+            m_status.rewind_enabled = command.value != 0;
+            if (!m_status.rewind_enabled)
+                m_rewind.clear();
+            break;
+
+        case Command::Type::SetRunAhead:
+            m_status.run_ahead_frames = command.value;
+            break;
+
+        case Command::Type::SetSpeed:
+            m_machine.set_instructions_per_second((uint32_t)command.value);
+            break;
+
+        case Command::Type::SetEngine:
+            m_machine.set_engine(static_cast<Machine::Engine>(command.value));
+            break;
+
+        case Command::Type::SetQuirks:
+            m_machine.set_quirk_profile(static_cast<QuirkProfile>(command.value));
+            break;
+
+        case Command::Type::SetPinnedCore:
+            if (platform::pin_current_thread(command.value))
+                m_status.pinned_core = command.value;
+            else
+                logger::error("Cannot pin the emulation thread to core %d", command.value);
+            break;
+
+        case Command::Type::SaveState:
+            save_state();
+            break;
+
+        case Command::Type::LoadState:
+            load_state();
+            break;
+
+        case Command::Type::StartRecording:
+            start_recording();
+            break;
+
+        case Command::Type::StopRecording:
+            stop_recording();
+            break;
+
+        case Command::Type::WriteMemory:
+            // A movie only replays the keys, the edit ends it
+            if (m_status.recording)
+            {
+                logger::info("Memory edited, recording stopped");
+                stop_recording();
+            }
+            m_machine.write_memory((uint16_t)command.value, (uint8_t)command.argument);
+            break;
+        }
+    }
+
+    return handled;
+}
+
+void Emulator::publish_frame()
+{
+    m_status.instructions_per_second = (int)m_machine.instructions_per_second();
+    m_status.engine = m_machine.engine();
+    m_status.quirk_profile = m_machine.quirk_profile();
+
+    Frame& next = m_frames.back();
+    std::memcpy(next.display, m_presented, sizeof(next.display));
+    next.registers = m_machine.registers();
+    std::memcpy(next.memory, m_machine.memory(), sizeof(next.memory));
+    next.status = m_status;
 
-        // TODO: Tick CPU for about a frame or until waiting for key press
-        std::this_thread::sleep_for(std::chrono::microseconds(150));
+    m_frames.publish();
+}
+
+void Emulator::emulate_frame()
+{
+    // Keys only change between passes of the emulation loop
+    const uint16_t keys = (uint16_t)m_input;
+    m_machine.run_frame();
+    m_speed_frames++;
+
+    if (m_status.recording)
+        m_movie.record_frame(keys, m_machine);
+}
+
+void Emulator::update_display(const uint64_t* display, uint32_t dirty_rows)
+{
+    for (uint32_t row = 0; row < DisplayHeight; row++)
+    {
+        if ((dirty_rows & (1u << row)) != 0)
+            m_presented[row] = display[row];
     }
 }
 
+void Emulator::set_sound(bool enabled, uint64_t cycle)
+{
+    m_beeper.set_sound(enabled, cycle, m_machine.instructions_per_second());
+}
+
+bool Emulator::is_key_pressed(uint8_t key)
+{
+    return (m_input & (1 << key)) != 0;
+}
+
 void Emulator::handle_input()
 {
     SDL_Event event {};
@@ -197,22 +491,35 @@ void Emulator::handle_input()
                 event.key.keysym.mod & KMOD_CTRL &&
                 event.key.repeat == 0)
             {
-                reset();
+                send(Command::Type::Reset);
             }
 
             if (event.key.keysym.sym == SDLK_s &&
                 event.key.keysym.mod & KMOD_CTRL &&
                 event.key.repeat == 0)
             {
-                stop();
+                send(Command::Type::Stop);
             }
 
             if (event.key.keysym.sym == SDLK_p &&
                 event.key.keysym.mod & KMOD_CTRL &&
                 event.key.repeat == 0)
             {
-                toggle_pause();
+                send(Command::Type::SetPaused, !frame().status.paused);
             }
+
+            if (event.key.keysym.sym == SDLK_t &&
+                event.key.keysym.mod & KMOD_CTRL &&
+                event.key.repeat == 0)
+            {
+                send(Command::Type::SetTurbo, !frame().status.turbo);
+            }
+
+            if (event.key.keysym.sym == SDLK_F5 && event.key.repeat == 0)
+                send(Command::Type::SaveState);
+
+            if (event.key.keysym.sym == SDLK_F9 && event.key.repeat == 0)
+                send(Command::Type::LoadState);
             break;
 
         case SDL_WINDOWEVENT:
@@ -227,23 +534,65 @@ void Emulator::handle_input()
             break;
         }
     }
+
+    // The held keys, Tab and Backspace go to the emulation thread when they change
+    const Uint8* keyboard = SDL_GetKeyboardState(nullptr);
+    int input = 0;
+    for (uint32_t key = 0; key < KeyCount; key++)
+    {
+        if (keyboard[m_keymap[key]])
+            input |= 1 << key;
+    }
+
+    if (keyboard[SDL_SCANCODE_TAB])
+        input |= InputFastForward;
+    if (keyboard[SDL_SCANCODE_BACKSPACE])
+        input |= InputRewind;
+
+    if (input != m_sent_input && send(Command::Type::Input, input))
+        m_sent_input = input;
 }
 
-void Emulator::update_color_buffer()
+// Expands the band of rows between the first and last changed ones straight
+// into the locked texture. Locked pixels are write only, every row of the band
+// is written even when it did not change.
+void Emulator::update_texture()
 {
-    for (int index = 0; index < (DisplayWidth * DisplayHeight); index++)
+    if (m_texture_dirty_rows == 0)
+        return;
+
+    int first = 0;
+    while ((m_texture_dirty_rows & (1u << first)) == 0)
+        first++;
+
+    int last = DisplayHeight - 1;
+    while ((m_texture_dirty_rows & (1u << last)) == 0)
+        last--;
+
+    SDL_Rect rows = { 0, first, (int)DisplayWidth, last - first + 1 };
+    void* pixels = nullptr;
+    int pitch = 0;
+    if (SDL_LockTexture(m_texture, &rows, &pixels, &pitch) != 0)
+    {
+        logger::error("Cannot lock display texture: %s", SDL_GetError());
+        return;
+    }
+
+    for (int row = first; row <= last; row++)
     {
-        uint8_t pixel = m_display[index];
-        m_color_buffer[index] = (0x00FFFF00 * pixel) | 0xFF000000;
+        uint32_t* colors = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(pixels) + (row - first) * pitch);
+        palette::expand(&m_display[row], 1, m_palette, colors);
     }
 
-    m_display_updated = false;
+    SDL_UnlockTexture(m_texture);
+    m_texture_dirty_rows = 0;
 }
 
 void Emulator::render()
 {
     SDL_RenderClear(m_renderer);
-    SDL_UpdateTexture(m_texture, nullptr, m_color_buffer, DisplayWidth * sizeof(uint32_t));
+    update_texture();
+
     SDL_Rect screen_rect = { 0, (int)ImGui::GetFrameHeight(), m_window_width, m_window_height - (int)ImGui::GetFrameHeight() };
     SDL_RenderCopy(m_renderer, m_texture, nullptr, &screen_rect);
 
@@ -260,12 +609,22 @@ void Emulator::render_user_interface()
     ImGui::NewFrame();
 
     render_menubar();
+
+    // The dialogs pause the emulation while they are open
     if (m_should_exit)
+    {
         ImGui::OpenPopup("Exit");
+        send(Command::Type::SetPaused, 1);
+        m_should_exit = false;
+    }
     render_exit_dialog();
 
     if (m_show_about)
+    {
         ImGui::OpenPopup("About");
+        send(Command::Type::SetPaused, 1);
+        m_show_about = false;
+    }
     render_about_dialog();
 
     if (m_show_cpu_window)
@@ -274,6 +633,9 @@ void Emulator::render_user_interface()
     if (m_memory_window->Open)
         render_memory_window();
 
+    if (m_show_stats_window)
+        render_stats_window();
+
     ImGui::EndFrame();
     ImGui::Render();
 
@@ -282,6 +644,8 @@ void Emulator::render_user_interface()
 
 void Emulator::render_menubar()
 {
+    const Status& status = frame().status;
+
     if (ImGui::BeginMainMenuBar())
     {
         if (ImGui::BeginMenu("File"))
@@ -289,6 +653,13 @@ void Emulator::render_menubar()
             if (ImGui::MenuItem("Open ROM...", "Ctr+O"))
                 open_rom_file();
 
+            ImGui::Separator();
+            if (ImGui::MenuItem("Save State", "F5", false, status.rom_loaded))
+                send(Command::Type::SaveState);
+
+            if (ImGui::MenuItem("Load State", "F9", false, status.rom_loaded))
+                send(Command::Type::LoadState);
+
             ImGui::Separator();
             if (ImGui::MenuItem("Exit", "Alt+F4"))
                 m_should_exit = true;
@@ -298,19 +669,102 @@ void Emulator::render_menubar()
 
         if (ImGui::BeginMenu("Emulation"))
         {
-            std::string pause_str = "Pause";
-            if (m_paused)
-                pause_str = "Resume";
-
-            if (ImGui::MenuItem(pause_str.c_str(), "Ctr+P"))
-                toggle_pause();
+            if (ImGui::MenuItem(status.paused ? "Resume" : "Pause", "Ctr+P"))
+                send(Command::Type::SetPaused, !status.paused);
 
             if (ImGui::MenuItem("Reset", "Ctr+R"))
-                reset();
+                send(Command::Type::Reset);
+
+            if (ImGui::MenuItem("Turbo", "Ctr+T", status.turbo))
+                send(Command::Type::SetTurbo, !status.turbo);
+
+            if (ImGui::MenuItem("Rewind", "Backspace", status.rewind_enabled))
+                send(Command::Type::SetRewind, !status.rewind_enabled);
+
+            if (ImGui::MenuItem(status.recording ? "Stop Recording" : "Record Movie", NULL, false, status.rom_loaded))
+                send(status.recording ? Command::Type::StopRecording : Command::Type::StartRecording);
+
+            if (ImGui::BeginMenu("Run-Ahead"))
+            {
+                int frames = status.run_ahead_frames;
+                if (ImGui::SliderInt("Frames", &frames, 0, MaxRunAheadFrames))
+                    send(Command::Type::SetRunAhead, frames);
+                ImGui::EndMenu();
+            }
 
             ImGui::Separator();
             if (ImGui::MenuItem("Stop", "Ctr+S"))
-                stop();
+                send(Command::Type::Stop);
+
+            ImGui::Separator();
+            // A movie replays at the speed it was recorded with
+            if (ImGui::BeginMenu("Speed", !status.recording))
+            {
+                int instructions_per_second = status.instructions_per_second;
+                if (ImGui::SliderInt("Instructions per second", &instructions_per_second, MinInstructionsPerSecond, MaxInstructionsPerSecond))
+                    send(Command::Type::SetSpeed, instructions_per_second);
+
+                if (ImGui::MenuItem("Default"))
+                    send(Command::Type::SetSpeed, Machine::DefaultInstructionsPerSecond);
+
+                ImGui::EndMenu();
+            }
+
+            if (ImGui::BeginMenu("Engine"))
+            {
+                static const struct { const char* name; Machine::Engine engine; } engines[] = {
+                    { "Switch", Machine::Engine::Switch },
+                    { "Cached", Machine::Engine::Cached },
+                    { "Threaded", Machine::Engine::Threaded },
+                    { "Table", Machine::Engine::Table },
+                    { "JIT", Machine::Engine::Jit },
+                };
+
+                for (const auto& entry : engines)
+                {
+                    const bool available = entry.engine != Machine::Engine::Jit || Machine::jit_available();
+                    if (ImGui::MenuItem(entry.name, NULL, status.engine == entry.engine, available))
+                        send(Command::Type::SetEngine, static_cast<int>(entry.engine));
+                }
+
+                ImGui::EndMenu();
+            }
+
+            // Programs written for another interpreter need its behaviours, a
+            // movie replays with the profile it was recorded with
+            if (ImGui::BeginMenu("Quirks", !status.recording))
+            {
+                for (QuirkProfile profile : quirks::Profiles)
+                {
+                    if (ImGui::MenuItem(quirks::label(profile), NULL, status.quirk_profile == profile))
+                        send(Command::Type::SetQuirks, static_cast<int>(profile));
+                }
+
+                ImGui::EndMenu();
+            }
+
+            // The emulation thread runs on any core unless pinned to one
+            if (ImGui::BeginMenu("Pin Thread"))
+            {
+                int core = status.pinned_core;
+                const int last_core = (int)std::thread::hardware_concurrency() - 1;
+                if (ImGui::SliderInt("Core", &core, -1, last_core, core < 0 ? "Any" : "%d"))
+                    send(Command::Type::SetPinnedCore, core);
+                ImGui::EndMenu();
+            }
+
+            // Smaller buffers play the sound sooner, too small ones make it crackle
+            if (ImGui::BeginMenu("Audio Buffer"))
+            {
+                for (int samples : { 256, 512, 1024, 2048 })
+                {
+                    char label[32];
+                    std::snprintf(label, sizeof(label), "%d samples", samples);
+                    if (ImGui::MenuItem(label, NULL, m_audio_buffer == samples) && m_audio_buffer != samples)
+                        open_audio(samples);
+                }
+                ImGui::EndMenu();
+            }
 
             ImGui::EndMenu();
         }
@@ -318,9 +772,46 @@ void Emulator::render_menubar()
         if (ImGui::BeginMenu("View"))
         {
             ImGui::MenuItem("CPU Window", NULL, &m_show_cpu_window);
+            ImGui::MenuItem("Stats Window", NULL, &m_show_stats_window);
             ImGui::MenuItem("Memory Window", NULL, &m_memory_window->Open);
             ImGui::Separator();
 
+            if (ImGui::MenuItem("VSync", NULL, &m_vsync) && SDL_RenderSetVSync(m_renderer, m_vsync ? 1 : 0) != 0)
+            {
+                logger::error("Cannot change vsync: %s", SDL_GetError());
+                m_vsync = !m_vsync;
+            }
+
+            if (ImGui::BeginMenu("Target FPS", !m_vsync))
+            {
+                ImGui::SliderInt("Presents per second", &m_target_fps, MinTargetFps, MaxTargetFps);
+                ImGui::EndMenu();
+            }
+
+            ImGui::MenuItem("Frame Pacing", NULL, &m_show_frame_pacing);
+            ImGui::Separator();
+
+            if (ImGui::BeginMenu("Palette"))
+            {
+                for (const Palette& preset : palette::Presets)
+                {
+                    if (ImGui::MenuItem(preset.name, NULL, std::strcmp(m_palette.name, preset.name) == 0))
+                        set_palette(preset);
+                }
+
+                ImGui::Separator();
+
+                Palette custom = m_palette;
+                bool changed = edit_color("Background", custom.colors[0]);
+                changed |= edit_color("Foreground", custom.colors[1]);
+                if (changed)
+                {
+                    custom.name = "Custom";
+                    set_palette(custom);
+                }
+                ImGui::EndMenu();
+            }
+
             if (ImGui::BeginMenu("Theme"))
             {
                 if (ImGui::MenuItem(("Custom theme")))
@@ -348,6 +839,18 @@ void Emulator::render_menubar()
             ImGui::EndMenu();
         }
 
+        if (status.rom_loaded && !status.paused)
+        {
+            ImGui::Separator();
+            ImGui::Text("x%.1f", status.speed);
+        }
+
+        if (m_show_frame_pacing)
+        {
+            ImGui::Separator();
+            ImGui::Text("%.2f frames/present", m_frames_per_present);
+        }
+
         ImGui::EndMainMenuBar();
     }
 }
@@ -356,9 +859,6 @@ void Emulator::render_exit_dialog()
 {
     if (ImGui::BeginPopupModal("Exit", NULL, ImGuiWindowFlags_AlwaysAutoResize))
     {
-        m_should_exit = false;
-        m_paused = true;
-
         ImGui::Text("Are you sure you want to exit?");
         ImGui::Separator();
 
@@ -373,7 +873,7 @@ void Emulator::render_exit_dialog()
 
         if (ImGui::Button("No", ImVec2(120, 0)))
         {
-            m_paused = false;
+            send(Command::Type::SetPaused, 0);
             ImGui::CloseCurrentPopup();
         }
 
@@ -385,9 +885,6 @@ void Emulator::render_about_dialog()
 {
     if (ImGui::BeginPopupModal("About", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
     {
-        m_show_about = false;
-        m_paused = true;
-
         ImGui::Text(CHIP8_VERSION_NAME);
         ImGui::Text("Version: %s", CHIP8_VERSION_NUMBER);
         ImGui::Separator();
@@ -395,7 +892,7 @@ void Emulator::render_about_dialog()
         ImGui::SetItemDefaultFocus();
         if (ImGui::Button("OK", ImVec2(120, 0)))
         {
-            m_paused = false;
+            send(Command::Type::SetPaused, 0);
             ImGui::CloseCurrentPopup();
         }
 
@@ -407,430 +904,249 @@ void Emulator::render_cpu_window()
 {
     ImGui::Begin("CPU", &m_show_cpu_window);
 
-    ImGui::Text("   PC: 0x%04X", m_registers.PC);
-    ImGui::Text("   SP: 0x%04X", m_registers.SP);
-    ImGui::Text("    I: 0x%04X", m_registers.I);
-
-    ImGui::Text(" V[0]: 0x%02X", m_registers.V[0]); ImGui::SameLine();
-    ImGui::Text(" V[1]: 0x%02X", m_registers.V[1]); ImGui::SameLine();
-    ImGui::Text(" V[2]: 0x%02X", m_registers.V[2]); ImGui::SameLine();
-    ImGui::Text(" V[3]: 0x%02X", m_registers.V[3]);
-    ImGui::Text(" V[4]: 0x%02X", m_registers.V[4]); ImGui::SameLine();
-    ImGui::Text(" V[5]: 0x%02X", m_registers.V[5]); ImGui::SameLine();
-    ImGui::Text(" V[6]: 0x%02X", m_registers.V[6]); ImGui::SameLine();
-    ImGui::Text(" V[7]: 0x%02X", m_registers.V[7]);
-    ImGui::Text(" V[8]: 0x%02X", m_registers.V[8]); ImGui::SameLine();
-    ImGui::Text(" V[9]: 0x%02X", m_registers.V[9]); ImGui::SameLine();
-    ImGui::Text("V[10]: 0x%02X", m_registers.V[10]); ImGui::SameLine();
-    ImGui::Text("V[11]: 0x%02X", m_registers.V[11]);
-    ImGui::Text("V[12]: 0x%02X", m_registers.V[12]); ImGui::SameLine();
-    ImGui::Text("V[13]: 0x%02X", m_registers.V[13]); ImGui::SameLine();
-    ImGui::Text("V[14]: 0x%02X", m_registers.V[14]); ImGui::SameLine();
-    ImGui::Text("V[15]: 0x%02X", m_registers.V[15]);
+    const Machine::Registers& registers = frame().registers;
+
+    ImGui::Text("   PC: 0x%04X", registers.PC);
+    ImGui::Text("   SP: 0x%04X", registers.SP);
+    ImGui::Text("    I: 0x%04X", registers.I);
+
+    ImGui::Text(" V[0]: 0x%02X", registers.V[0]); ImGui::SameLine();
+    ImGui::Text(" V[1]: 0x%02X", registers.V[1]); ImGui::SameLine();
+    ImGui::Text(" V[2]: 0x%02X", registers.V[2]); ImGui::SameLine();
+    ImGui::Text(" V[3]: 0x%02X", registers.V[3]);
+    ImGui::Text(" V[4]: 0x%02X", registers.V[4]); ImGui::SameLine();
+    ImGui::Text(" V[5]: 0x%02X", registers.V[5]); ImGui::SameLine();
+    ImGui::Text(" V[6]: 0x%02X", registers.V[6]); ImGui::SameLine();
+    ImGui::Text(" V[7]: 0x%02X", registers.V[7]);
+    ImGui::Text(" V[8]: 0x%02X", registers.V[8]); ImGui::SameLine();
+    ImGui::Text(" V[9]: 0x%02X", registers.V[9]); ImGui::SameLine();
+    ImGui::Text("V[10]: 0x%02X", registers.V[10]); ImGui::SameLine();
+    ImGui::Text("V[11]: 0x%02X", registers.V[11]);
+    ImGui::Text("V[12]: 0x%02X", registers.V[12]); ImGui::SameLine();
+    ImGui::Text("V[13]: 0x%02X", registers.V[13]); ImGui::SameLine();
+    ImGui::Text("V[14]: 0x%02X", registers.V[14]); ImGui::SameLine();
+    ImGui::Text("V[15]: 0x%02X", registers.V[15]);
 
     ImGui::End();
 }
 
-void Emulator::render_memory_window()
+void Emulator::render_stats_window()
 {
-    m_memory_window->DrawWindow("Memory", m_memory, sizeof(m_memory), ResetVector);
-}
+    ImGui::Begin("Stats", &m_show_stats_window);
 
-void Emulator::reset()
-{
-    m_registers.PC = ResetVector;
-    m_registers.SP = 0x00;
-    m_registers.I = 0x00;
-    m_delay_timer = 0;
-    m_sound_timer = 0;
-
-    m_opcode.type = 0;
-    m_opcode.x = 0;
-    m_opcode.y = 0;
-    m_opcode.n = 0;
-    m_opcode.kk = 0;
-    m_opcode.nnn = 0;
+    const Status& status = frame().status;
+    const double frame_budget = 1000.0 / FrameRate;
+    const double total = status.emulation_time + status.run_ahead_time;
 
-    for (int index = 0; index < 16; index++)
-        m_registers.V[index] = 0x00;
+    ImGui::Text("Emulation: %.3f ms", status.emulation_time);
+    ImGui::Text("Run-ahead: %.3f ms (%d frames)", status.run_ahead_time, status.run_ahead_frames);
+    ImGui::Text("    Total: %.3f ms, %.1f%% of the frame", total, total * 100.0 / frame_budget);
+    ImGui::Text("Presents: %d Hz%s, %.2f emulated frames each", m_vsync ? m_refresh_rate : m_target_fps, m_vsync ? " vsync" : "", m_frames_per_present);
+    ImGui::Text("Audio: %.1f ms latency, %u late changes, %u resyncs", m_beeper.latency() * 1000.0 / m_beeper.sample_rate(), m_beeper.late_events(), m_beeper.resyncs());
 
-    std::memset(m_stack, 0x00, sizeof(m_stack));
-    std::memset(m_display, 0x00, sizeof(m_display));
-    m_display_updated = true;
-
-    if (m_paused)
-        m_paused = false;
+    ImGui::End();
 }
 
-void Emulator::stop()
+void Emulator::render_memory_window()
 {
-    std::memset(m_memory, 0x00, sizeof(m_memory));
-    m_rom_loaded = false;
-    reset();
-}
+    // The window shows the memory of the latest frame
+    const uint8_t* memory = frame().memory;
+    std::memcpy(m_memory_view, memory, sizeof(m_memory_view));
+    m_memory_window->DrawWindow("Memory", m_memory_view, sizeof(m_memory_view), Machine::ResetVector);
 
-void Emulator::toggle_pause()
-{
-    m_paused = !m_paused;
+    // Edited bytes are written through the machine so the decoded instructions are invalidated
+    for (uint32_t address = 0; address < Machine::MemorySize; address++)
+    {
+        if (m_memory_view[address] != memory[address])
+            send(Command::Type::WriteMemory, (int)address, m_memory_view[address]);
+    }
 }
 
-uint8_t Emulator::read(uint16_t address)
+void Emulator::reset()
 {
-    return m_memory[address];
+    stop_recording();
+    m_machine.reset();
+    m_status.paused = false;
 }
 
-uint16_t Emulator::read_word(uint16_t address)
+void Emulator::stop()
 {
-    return (read(address) << 8 | read(address + 1));
+    m_machine.clear_memory();
+    m_rewind.clear();
+    m_status.rom_loaded = false;
+    reset();
 }
 
-void Emulator::write(uint16_t address, uint8_t value)
+// Shows the frame reached by running the next frames with the keys held now,
+// then goes back to the real frame. Games that react to a key a few frames
+// later then answer on the frame it is pressed.
+void Emulator::run_ahead()
 {
-    m_memory[address] = value;
-}
+    m_machine.save_state(m_run_ahead_state, sizeof(m_run_ahead_state));
 
-void Emulator::stack_push(uint16_t value)
-{
-    m_stack[m_registers.SP] = value;
-    m_registers.SP++;
-}
+    // The sound of these frames plays when they run for real
+    m_machine.set_audio(nullptr);
+    for (int frame = 0; frame < m_status.run_ahead_frames; frame++)
+        m_machine.run_frame();
+    m_machine.set_audio(this);
 
-uint16_t Emulator::stack_pop()
-{
-    m_registers.SP--;
-    return m_stack[m_registers.SP];
+    m_machine.present();
+    m_machine.load_state(m_run_ahead_state, sizeof(m_run_ahead_state));
 }
 
-void Emulator::fetch()
+void Emulator::open_rom_file()
 {
-    uint16_t value = read_word(m_registers.PC);
+    std::string rom_path = platform::open_file_dialog(m_window);
+    if (rom_path.empty())
+        return;
 
-    // Decode instruction
-    m_opcode.type = (value >> 12) & 0x000F;
-    m_opcode.x = (value >> 8) & 0x000F;
-    m_opcode.y = (value >> 4) & 0x000F;
-    m_opcode.n = value & 0x000F;
-    m_opcode.kk = value & 0x00FF;
-    m_opcode.nnn = value & 0x0FFF;
+#ifdef __linux__
+    // Remove '\n' from rom path, fixme
+    rom_path.pop_back();
+#endif // Linux
 
-    // Increment program counter
-    m_registers.PC += 2;
+    send(Command::Type::LoadRom, 0, 0, rom_path);
 }
 
-void Emulator::execute_next_instruction()
+// The device keeps playing, the beeper renders silence while the sound is off.
+// Changes play two buffers after their emulated time, one for the callback
+// taking a whole buffer and one for the frames arriving unevenly.
+bool Emulator::open_audio(int samples)
 {
-    fetch();
-
-    switch (m_opcode.type)
-    {
-    case 0x0:
-        switch (m_opcode.nnn)
-        {
-        case 0x0E0:
-            std::memset(m_display, 0x00, sizeof(m_display));
-            m_display_updated = true;
-            break;
-
-        case 0x00EE:
-            m_registers.PC = stack_pop();
-            break;
-        }
-        break;
-
-    case 0x1:
-        m_registers.PC = m_opcode.nnn;
-        break;
-
-    case 0x2:
-        stack_push(m_registers.PC);
-        m_registers.PC = m_opcode.nnn;
-        break;
-
-    case 0x3:
-        if (m_registers.V[m_opcode.x] == m_opcode.kk)
-            m_registers.PC += 2;
-        break;
-
-    case 0x4:
-        if (m_registers.V[m_opcode.x] != m_opcode.kk)
-            m_registers.PC += 2;
-        break;
-
-    case 0x5:
-        if (m_registers.V[m_opcode.x] == m_registers.V[m_opcode.y])
-            m_registers.PC += 2;
-        break;
-
-    case 0x6:
-        m_registers.V[m_opcode.x] = m_opcode.kk;
-        break;
-
-    case 0x7:
-        m_registers.V[m_opcode.x] += m_opcode.kk;
-        break;
-
-    case 0x8:
-        switch (m_opcode.n)
-        {
-        case 0x0:
-            m_registers.V[m_opcode.x] = m_registers.V[m_opcode.y];
-            break;
-
-        case 0x1:
-            m_registers.V[m_opcode.x] |= m_registers.V[m_opcode.y];
-            break;
-
-        case 0x2:
-            m_registers.V[m_opcode.x] &= m_registers.V[m_opcode.y];
-            break;
-
-        case 0x3:
-            m_registers.V[m_opcode.x] ^= m_registers.V[m_opcode.y];
-            break;
-
-        case 0x4:
-            m_registers.V[0xF] = (((uint16_t)m_registers.V[m_opcode.x] + (uint16_t)m_registers.V[m_opcode.y]) > 0xFF) ? 1 : 0;
-            m_registers.V[m_opcode.x] += m_registers.V[m_opcode.y];
-            break;
-
-        case 0x5:
-            m_registers.V[0xF] = (m_registers.V[m_opcode.x] > m_registers.V[m_opcode.y]) ? 1 : 0;
-            m_registers.V[m_opcode.x] -= m_registers.V[m_opcode.y];
-            break;
-
-        case 0x6:
-            m_registers.V[0xF] = m_registers.V[m_opcode.x] & 1;
-            m_registers.V[m_opcode.x] >>= 1;
-            break;
-
-        case 0x7:
-            m_registers.V[0xF] = (m_registers.V[m_opcode.y] > m_registers.V[m_opcode.x]) ? 1 : 0;
-            m_registers.V[m_opcode.x] = m_registers.V[m_opcode.y] - m_registers.V[m_opcode.x];
-            break;
-
-        case 0xE:
-            m_registers.V[0xF] = (m_registers.V[m_opcode.y] >> 7) & 1;
-            m_registers.V[m_opcode.x] = m_registers.V[m_opcode.y] << 1;
-            break;
-        }
-        break;
-
-    case 0x9:
-        if (m_registers.V[m_opcode.x] != m_registers.V[m_opcode.y])
-            m_registers.PC += 2;
-        break;
-
-    case 0xA:
-        m_registers.I = m_opcode.nnn;
-        break;
-
-    case 0xB:
-        m_registers.PC = m_opcode.nnn + m_registers.V[0];
-        break;
-
-    case 0xC:
-        m_registers.V[m_opcode.x] = generate_random_byte() & m_opcode.kk;
-        break;
+    if (m_audio_device != 0)
+        SDL_CloseAudioDevice(m_audio_device);
 
-    case 0xD:
-        draw_pixel();
-        break;
-
-    case 0xE:
-        switch (m_opcode.kk)
-        {
-        case 0x9E:
-            if (SDL_GetKeyboardState(nullptr)[m_keymap[m_registers.V[m_opcode.x] & 15]])
-                m_registers.PC += 2;
-            break;
-
-        case 0xA1:
-            if (!SDL_GetKeyboardState(nullptr)[m_keymap[m_registers.V[m_opcode.x] & 15]])
-                m_registers.PC += 2;
-            break;
-        }
-        break;
-
-    case 0xF:
-        switch (m_opcode.kk)
-        {
-        case 0x07:
-            m_registers.V[m_opcode.x] = m_delay_timer;
-            break;
-
-        case 0x0A:
-            if (!wait_key_press())
-                m_registers.PC -= 2;
-            break;
-
-        case 0x15:
-            m_delay_timer = m_registers.V[m_opcode.x];
-            break;
-
-        case 0x18:
-            m_sound_timer = m_registers.V[m_opcode.x];
-            break;
-
-        case 0x1E:
-            m_registers.V[0xF] = ((m_registers.I + m_registers.V[m_opcode.x]) > 0xFFF) ? 1 : 0;
-            m_registers.I += m_registers.V[m_opcode.x];
-            break;
-
-        case 0x29:
-            m_registers.I = m_registers.V[m_opcode.x] * 5;
-            break;
-
-        case 0x33:
-            m_memory[m_registers.I & 0xFFF] = (m_registers.V[m_opcode.x] % 1000) / 100;
-            m_memory[(m_registers.I + 1) & 0xFFF] =  (m_registers.V[m_opcode.x] / 10) % 10;
-            m_memory[(m_registers.I + 2) & 0xFFF] = m_registers.V[m_opcode.x] % 10;
-            break;
+    SDL_AudioSpec audio_spec {};
+    audio_spec.freq     = (int)m_beeper.sample_rate();
+    audio_spec.format   = AUDIO_S16;
+    audio_spec.channels = 1;
+    audio_spec.samples  = (Uint16)samples;
+    audio_spec.userdata = this;
 
-        case 0x55:
-            for (int index = 0; index <= m_opcode.x; index++)
-                m_memory[(m_registers.I++) & 0xFFF] = m_registers.V[index];
-            break;
+    audio_spec.callback = [](void *user_data, unsigned char *stream, int size)
+    {
+        Emulator *emu = static_cast<Emulator*>(user_data);
+        const uint32_t channels = emu->m_audio_spec.channels;
+        emu->m_beeper.render(reinterpret_cast<int16_t*>(stream), (uint32_t)size / (sizeof(int16_t) * channels), channels);
+    };
 
-        case 0x65:
-            for (int index = 0; index <= m_opcode.x; index++)
-                m_registers.V[index] = m_memory[(m_registers.I++) & 0xFFF];
-            break;
-        }
-        break;
+    m_audio_device = SDL_OpenAudioDevice(nullptr, 0, &audio_spec, &m_audio_spec, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+    if (m_audio_device == 0)
+    {
+        logger::error("SDL_OpenAudioDevice error: %s", SDL_GetError());
+        return false;
     }
+
+    m_audio_buffer = m_audio_spec.samples;
+    m_beeper.set_latency(2u * m_audio_spec.samples);
+    SDL_PauseAudioDevice(m_audio_device, 0);
+    return true;
 }
 
-void Emulator::update_timers()
+void Emulator::load_rom_from_file(const std::string& rom_path)
 {
-    if (m_delay_timer > 0)
-        m_delay_timer--;
+    std::ifstream rom_file(rom_path, std::ifstream::binary);
+    if (!rom_file.is_open())
+    {
+       logger::error("Cannot open ROM file %s", rom_path.c_str());
+       return;
+    }
 
-    if (m_sound_timer > 0)
+    uint32_t buffer_size = utils::get_file_size(rom_path);
+    if ((Machine::MemorySize - Machine::ResetVector) < buffer_size)
     {
-        SDL_PauseAudioDevice(m_audio_device, 0);
-        m_sound_timer--;
+        logger::error("Invalid ROM size");
+        return;
     }
-    else
+
+    std::vector<uint8_t> buffer(buffer_size);
+    if (!rom_file.read(reinterpret_cast<char*>(buffer.data()), buffer_size))
     {
-        SDL_PauseAudioDevice(m_audio_device, 1);
+        logger::error("Cannot read ROM from file %s", rom_path.c_str());
+        return;
     }
-}
 
-uint8_t Emulator::generate_random_byte()
-{
-    std::random_device rand_dev;
-    std::mt19937 rng(rand_dev());
-    std::uniform_int_distribution<std::mt19937::result_type> dist(0,255);
-    return dist(rng);
+    // A new random sequence for every loaded ROM, reset replays it
+    std::random_device device;
+    m_machine.set_seed((static_cast<uint64_t>(device()) << 32) | device());
+
+    stop_recording();
+    m_machine.load_rom(buffer.data(), buffer_size);
+    m_rewind.clear();
+    m_status.rom_loaded = true;
+    m_rom_path = rom_path;
+    m_rom = std::move(buffer);
+    reset();
 }
 
-void Emulator::draw_pixel()
+// The state of a ROM is kept next to it in rom_path.state
+void Emulator::save_state()
 {
-    auto x = m_registers.V[m_opcode.x];
-    auto y = m_registers.V[m_opcode.y];
-    auto height = m_opcode.n;
-
-    m_registers.V[0xF] = 0;
-    for (uint8_t row = 0; row < height; row++)
-    {
-        uint8_t data = m_memory[m_registers.I + row];
-        for (uint8_t column = 0; column < 8; column++)
-        {
-            if ((data & 0x80) != 0)
-            {
-                if (m_display[(x + column + ((y + row) * 64))] == 1)
-                {
-                    m_registers.V[0xF] = 1;
-                }
-                m_display[x + column + ((y + row) * 64)] ^= 1;
-            }
+    if (!m_status.rom_loaded)
+        return;
 
-            data <<= 1;
-        }
-    }
+    uint8_t state[Machine::SaveStateSize];
+    m_machine.save_state(state, sizeof(state));
 
-    m_display_updated = true;
+    const std::string state_path = m_rom_path + ".state";
+    if (!utils::write_file(state_path, state, sizeof(state)))
+        logger::error("Cannot write state file %s", state_path.c_str());
 }
 
-bool Emulator::wait_key_press()
+void Emulator::load_state()
 {
-    bool key_pressed = false;
+    if (!m_status.rom_loaded)
+        return;
 
-    for (int index = 0; index < KeyCount; index++)
+    const std::string state_path = m_rom_path + ".state";
+    std::vector<uint8_t> state;
+    if (!utils::read_file(state_path, state))
     {
-        if (SDL_GetKeyboardState(nullptr)[m_keymap[index]])
-        {
-            m_registers.V[m_opcode.x] = index;
-            key_pressed = true;
-        }
+        logger::error("Cannot read state file %s", state_path.c_str());
+        return;
     }
 
-    return key_pressed;
+    stop_recording();
+    if (!m_machine.load_state(state.data(), (uint32_t)state.size()))
+    {
+        logger::error("Invalid state file %s", state_path.c_str());
+        return;
+    }
 }
 
-double Emulator::get_audio_sample()
+// A movie starts from the ROM freshly loaded into cleared memory, like
+// chip8_replay, and is written to rom_path.movie when it stops
+void Emulator::start_recording()
 {
-    double sample_rate = (double)(m_audio_spec.freq);
-    double period = sample_rate / 800;
-
-    m_audio_position++;
-    if (m_audio_position % (int)period == 0)
-        m_audio_position = 0;
-
-    double angular_freq = (1.0 / period) * 2.0 * M_PI;
-    return sin(m_audio_position * angular_freq);
-}
+    if (!m_status.rom_loaded || m_status.recording)
+        return;
 
-void Emulator::write_audio_data(uint8_t* buffer, double data)
-{
-    int16_t* b = (int16_t*)buffer;
-    double range = (double)INT16_MAX - (double)INT16_MIN;
-    double normalized = data * range / 2.0;
-    *b = normalized;
+    // Bytes the game wrote or a larger ROM left behind are not in the movie
+    reset();
+    m_machine.clear_memory();
+    m_machine.load_rom(m_rom.data(), (uint32_t)m_rom.size());
+    m_rewind.clear();
+    m_movie.start(m_machine, m_rom.data(), (uint32_t)m_rom.size());
+    m_status.recording = true;
 }
 
-void Emulator::open_rom_file()
+void Emulator::stop_recording()
 {
-    std::string rom_path = platform::open_file_dialog(m_window);
-    if (rom_path.empty())
+    if (!m_status.recording)
         return;
 
-#ifdef __linux__
-    // Remove '\n' from rom path, fixme
-    rom_path.pop_back();
-#endif // Linux
+    m_status.recording = false;
 
-    load_rom_from_file(rom_path);
+    const std::string movie_path = m_rom_path + ".movie";
+    if (!m_movie.save(movie_path))
+        logger::error("Cannot write movie file %s", movie_path.c_str());
 }
 
-void Emulator::load_rom_from_file(const std::string& rom_path)
+// Colors are only expanded for changed rows, a new palette redraws all of them
+void Emulator::set_palette(const Palette& palette)
 {
-    std::ifstream rom_file(rom_path, std::ifstream::binary);
-    if (!rom_file.is_open())
-    {
-       logger::error("Cannot open ROM file %s", rom_path.c_str());
-       return;
-    }
-
-    uint32_t buffer_size = utils::get_file_size(rom_path);
-    if ((MemorySize - ResetVector) < buffer_size)
-    {
-        logger::error("Invalid ROM size");
-        return;
-    }
-
-    char* buffer = static_cast<char*>(malloc(sizeof(char) * buffer_size));
-    if (!rom_file.read(buffer, buffer_size))
-    {
-        logger::error("Cannot read ROM from file %s", rom_path.c_str());
-        return;
-    }
-
-    for (int index = 0; index < buffer_size; index++)
-        m_memory[index + ResetVector] = (uint8_t)buffer[index];
-
-    m_rom_loaded = true;
-    reset();
+    m_palette = palette;
+    m_texture_dirty_rows = Machine::AllDisplayRows;
 }
 
 void Emulator::set_custom_dark_theme()
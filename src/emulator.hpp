@@ -1,83 +1,175 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <string>
+#include <thread>
+#include <vector>
 #include <SDL.h>
+#include "beeper.hpp"
+#include "machine.hpp"
+#include "movie.hpp"
+#include "palette.hpp"
+#include "rewind.hpp"
+#include "spsc_queue.hpp"
+#include "triple_buffer.hpp"
 
 struct MemoryEditor;
 
-class Emulator
+class Emulator final : private VideoBackend, private AudioBackend, private InputBackend
 {
 public:
     Emulator() = default;
     ~Emulator();
 
-    struct Registers
+    static inline constexpr uint32_t DisplayWidth = Machine::DisplayWidth;
+    static inline constexpr uint32_t DisplayHeight = Machine::DisplayHeight;
+    static inline constexpr uint32_t KeyCount = Machine::KeyCount;
+    static inline constexpr uint32_t FrameRate = Machine::TimerFrequency;
+    static inline constexpr int MinInstructionsPerSecond = 60;
+    static inline constexpr int MaxInstructionsPerSecond = 60000;
+    static inline constexpr int MaxRunAheadFrames = 8;
+    static inline constexpr int MinTargetFps = 30;
+    static inline constexpr int MaxTargetFps = 240;
+    static inline constexpr int DefaultAudioBuffer = 512;
+
+    bool init();
+    void run(int argc, char* argv[]);
+
+private:
+    // Settings and status owned by the emulation thread, the user interface
+    // reads them from the latest frame and changes them with commands
+    struct Status
     {
-        uint16_t PC = 0x0000;
-        uint16_t SP = 0x0000;
-        uint16_t I = 0x0000;
-        uint8_t V[16] = { 0 };
+        bool rom_loaded = false;
+        bool paused = false;
+        bool turbo = false;
+        bool rewind_enabled = true;
+        bool recording = false;
+        int run_ahead_frames = 0;
+        int instructions_per_second = Machine::DefaultInstructionsPerSecond;
+        Machine::Engine engine = Machine::Engine::Switch;
+        QuirkProfile quirk_profile = QuirkProfile::Modern;
+        int pinned_core = -1;
+
+        // Host time spent per frame in milliseconds, smoothed
+        double emulation_time = 0.0;
+        double run_ahead_time = 0.0;
+
+        // Emulated speed relative to real time, shown in the menu bar
+        double speed = 0.0;
+        uint64_t frame_count = 0;
     };
 
-    struct Opcode
+    // Handed from the emulation thread to the user interface after the
+    // frames of a pass, a consistent snapshot for the debug windows
+    struct Frame
     {
-        uint16_t type = 0x0000;
-        uint16_t x = 0x0000;
-        uint16_t y = 0x0000;
-        uint16_t n = 0x0000;
-        uint16_t kk = 0x0000;
-        uint16_t nnn = 0x0000;
+        uint64_t display[DisplayHeight] = { 0 };
+        Machine::Registers registers;
+        uint8_t memory[Machine::MemorySize] = { 0 };
+        Status status;
     };
 
-    static inline constexpr uint32_t MemorySize = 4096;
-    static inline constexpr uint32_t StackSize = 16;
-    static inline constexpr uint32_t FontSize = 80;
-    static inline constexpr uint32_t ResetVector = 0x200;
-    static inline constexpr uint32_t DisplayWidth = 64;
-    static inline constexpr uint32_t DisplayHeight = 32;
-    static inline constexpr uint32_t KeyCount = 16;
+    struct Command
+    {
+        enum class Type
+        {
+            Input, // value: held keys | InputFastForward | InputRewind
+            LoadRom, // path
+            Reset,
+            Stop,
+            SetPaused, // value: 0 or 1
+            SetTurbo,
+            SetRewind,
+            SetRunAhead, // value: frames
+            SetSpeed, // value: instructions per second
+            SetEngine, // value: Machine::Engine
+            SetQuirks, // value: QuirkProfile
+            SetPinnedCore, // value: core or -1
+            SaveState,
+            LoadState,
+            StartRecording,
+            StopRecording,
+            WriteMemory, // value: address, argument: byte
+        };
+
+        Type type = Type::Reset;
+        int value = 0;
+        int argument = 0;
+        std::string path;
+    };
 
-    bool init();
-    void run(int argc, char* argv[]);
+    static inline constexpr int InputFastForward = 1 << 16;
+    static inline constexpr int InputRewind = 1 << 17;
+    static inline constexpr uint32_t CommandCapacity = 256;
 
-private:
+    // User interface thread
     SDL_Window *m_window = nullptr;
     SDL_Renderer *m_renderer = nullptr;
     SDL_Texture *m_texture = nullptr;
     SDL_AudioSpec m_audio_spec {};
     SDL_AudioDeviceID m_audio_device = 0;
+    int m_audio_buffer = DefaultAudioBuffer; // Samples per callback
 
     MemoryEditor *m_memory_window = nullptr;
 
     int m_window_width = 500;
     int m_window_height = 250;
-    bool m_rom_loaded = false;
     bool m_should_exit = false;
     bool m_exit = false;
     bool m_show_about = false;
-    bool m_paused = false;
     bool m_show_cpu_window = false;
+    bool m_show_stats_window = false;
+    int m_sent_input = 0;
 
-    Registers m_registers;
-    Opcode m_opcode;
+    // Presents follow the display refresh with vsync, the target rate without
+    bool m_vsync = true;
+    int m_refresh_rate = FrameRate;
+    int m_target_fps = FrameRate;
+    bool m_show_frame_pacing = false;
+    double m_frames_per_present = 0.0; // Smoothed
+    uint64_t m_presented_frame_count = 0;
 
-    uint8_t m_memory[MemorySize] = { 0 };
-    uint16_t m_stack[StackSize] = { 0 };
-    uint8_t m_display[DisplayWidth * DisplayHeight] = { 0 };
-    uint32_t m_color_buffer[DisplayWidth * DisplayHeight] = { 0 };
-    bool m_display_updated = false;
-    uint8_t m_delay_timer = 0;
-    uint8_t m_sound_timer = 0;
+    Palette m_palette = palette::Presets[0];
+    uint64_t m_display[DisplayHeight] = { 0 }; // Last presented rows
+    uint32_t m_texture_dirty_rows = Machine::AllDisplayRows; // Rows not expanded to the texture yet
 
-    static uint8_t m_font[FontSize];
-    static int m_keymap[KeyCount];
+    // Copy of the frame memory edited by the memory window
+    uint8_t m_memory_view[Machine::MemorySize] = { 0 };
 
-    // Audio sample index
-    int m_audio_position = 0;
+    static int m_keymap[KeyCount];
 
+    // Between the threads
+    std::thread m_emulation_thread;
+    std::atomic<bool> m_quit { false };
+    TripleBuffer<Frame> m_frames;
+    SpscQueue<Command, CommandCapacity> m_commands;
+    Beeper m_beeper; // Fed by the emulation thread, rendered by the audio thread
+
+    // Emulation thread
+    Status m_status;
+    std::string m_rom_path;
+    std::vector<uint8_t> m_rom;
+    int m_input = 0;
+    uint32_t m_speed_frames = 0;
+    uint64_t m_presented[DisplayHeight] = { 0 }; // Rows given by the machine
+
+    Machine m_machine;
+    RewindBuffer m_rewind;
+    Movie m_movie;
+    uint8_t m_run_ahead_state[Machine::SaveStateSize] = { 0 };
+
+    void update_display(const uint64_t* display, uint32_t dirty_rows) override;
+    void set_sound(bool enabled, uint64_t cycle) override;
+    bool is_key_pressed(uint8_t key) override;
+
+    // User interface thread
+    const Frame& frame() const { return m_frames.front(); }
+    bool send(Command::Type type, int value = 0, int argument = 0, std::string path = {});
     void handle_input();
-    void update_color_buffer();
+    void take_frame();
+    void update_texture();
     void render();
     void render_user_interface();
     void render_menubar();
@@ -85,29 +177,23 @@ private:
     void render_about_dialog();
     void render_cpu_window();
     void render_memory_window();
+    void render_stats_window();
+    void open_rom_file();
+    bool open_audio(int samples);
+    void set_palette(const Palette& palette);
+    void set_custom_dark_theme();
 
+    // Emulation thread
+    void emulation_loop();
+    bool handle_commands();
+    void publish_frame();
     void reset();
     void stop();
-    void toggle_pause();
-    uint8_t read(uint16_t address);
-    uint16_t read_word(uint16_t address);
-    void write(uint16_t address, uint8_t value);
-    void stack_push(uint16_t value);
-    uint16_t stack_pop();
-    void fetch();
-    void execute_next_instruction();
-    void update_timers();
-
-    uint8_t generate_random_byte();
-
-    void draw_pixel();
-    bool wait_key_press();
-
-    double get_audio_sample();
-    void write_audio_data(uint8_t* buffer, double data);
-
-    void open_rom_file();
+    void run_ahead();
+    void emulate_frame();
     void load_rom_from_file(const std::string& rom_path);
-
-    void set_custom_dark_theme();
+    void save_state();
+    void load_state();
+    void start_recording();
+    void stop_recording();
 };
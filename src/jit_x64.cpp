@@ -0,0 +1,415 @@
+#include "jit_x64.hpp"
+#include "machine_ops.hpp"
+#include <cstddef>
+#include <cstring>
+
+#ifdef CHIP8_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Register file displacements from rbx in the generated code
+static constexpr uint8_t PC_OFFSET = offsetof(Machine::Registers, PC);
+static constexpr uint8_t SP_OFFSET = offsetof(Machine::Registers, SP);
+static constexpr uint8_t I_OFFSET = offsetof(Machine::Registers, I);
+static constexpr uint8_t V_OFFSET = offsetof(Machine::Registers, V);
+static constexpr uint8_t VF_OFFSET = V_OFFSET + 0xF;
+
+static_assert(V_OFFSET + 0xF < 0x80, "Register displacements must fit in a signed byte");
+
+Jit::Jit()
+{
+    void* code = mmap(nullptr, CodeBufferSize, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code != MAP_FAILED)
+        m_code = static_cast<uint8_t*>(code);
+
+    m_page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    m_emit.reserve(MaxBlockLength * 32);
+}
+
+Jit::~Jit()
+{
+    if (m_code)
+        munmap(m_code, CodeBufferSize);
+}
+
+void Jit::flush()
+{
+    for (auto& block : m_blocks)
+        block = Block();
+
+    std::memset(m_code_map, 0, sizeof(m_code_map));
+    m_code_used = 0;
+}
+
+void Jit::compile(const uint8_t* memory, uint16_t address)
+{
+    m_blocks[address >> 1] = Block();
+    m_blocks[address >> 1].compiled = true;
+
+    if (!m_code)
+        return;
+
+    m_emit.clear();
+
+    // push rbx, r12, r13, r14, then load the context pointers
+    emit({ 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56 });
+    emit({ 0x48, 0x8B, 0x1F });       // mov rbx, [rdi]
+    emit({ 0x4C, 0x8B, 0x67, 0x08 }); // mov r12, [rdi + 8]
+    emit({ 0x4C, 0x8B, 0x6F, 0x10 }); // mov r13, [rdi + 16]
+    emit({ 0x4C, 0x8B, 0x77, 0x18 }); // mov r14, [rdi + 24]
+
+    uint16_t pc = address;
+    uint16_t length = 0;
+    bool block_end = false;
+
+    while (!block_end && length < MaxBlockLength && pc + 1u < Machine::MemorySize)
+    {
+        uint16_t value = memory[pc] << 8 | memory[pc + 1];
+        if (!emit_instruction(value, pc, block_end))
+            break;
+
+        pc += 2;
+        length++;
+    }
+
+    if (length == 0)
+        return;
+
+    if (!block_end)
+        emit_store_pc(pc);
+
+    // pop r14, r13, r12, rbx and return
+    emit({ 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3 });
+
+    if (m_code_used + m_emit.size() > CodeBufferSize)
+    {
+        flush();
+        m_blocks[address >> 1].compiled = true;
+    }
+
+    // Only the pages the block lands on become writable, self modifying ROMs
+    // compile often
+    uint8_t* code = m_code + m_code_used;
+    const size_t first_page = m_code_used & ~(m_page_size - 1);
+    const size_t end_page = (m_code_used + m_emit.size() + m_page_size - 1) & ~(m_page_size - 1);
+    if (mprotect(m_code + first_page, end_page - first_page, PROT_READ | PROT_WRITE) != 0)
+        return;
+
+    std::memcpy(code, m_emit.data(), m_emit.size());
+    mprotect(m_code + first_page, end_page - first_page, PROT_READ | PROT_EXEC);
+    m_code_used += m_emit.size();
+
+    Block& block = m_blocks[address >> 1];
+    block.code = reinterpret_cast<BlockFunction>(code);
+    block.length = length;
+
+    for (uint16_t covered = address; covered < pc; covered++)
+        m_code_map[covered] = 1;
+}
+
+void Jit::set_quirks(const Quirks& quirks)
+{
+    m_quirks = quirks;
+    flush();
+}
+
+bool Jit::emit_instruction(uint16_t value, uint16_t address, bool& block_end)
+{
+    const uint8_t x = V_OFFSET + ((value >> 8) & 0x000F);
+    const uint8_t y = V_OFFSET + ((value >> 4) & 0x000F);
+    const uint8_t shift_source = m_quirks.shift_vy ? y : x;
+    const uint8_t kk = value & 0x00FF;
+    const uint16_t nnn = value & 0x0FFF;
+
+    switch (Machine::decode_op(value))
+    {
+    case Machine::OpNop:
+        break;
+
+    case Machine::Op00EE:
+        emit({ 0x66, 0xFF, 0x4B, SP_OFFSET });       // dec word [rbx + SP]
+        emit({ 0x0F, 0xB7, 0x43, SP_OFFSET });       // movzx eax, word [rbx + SP]
+        emit({ 0x83, 0xE0, 0x0F });                  // and eax, 0xF (keep the stack access in bounds)
+        emit({ 0x66, 0x41, 0x8B, 0x04, 0x44 });      // mov ax, [r12 + rax * 2]
+        emit({ 0x66, 0x89, 0x43, PC_OFFSET });       // mov [rbx + PC], ax
+        block_end = true;
+        break;
+
+    case Machine::Op1nnn:
+        emit_store_pc(nnn);
+        block_end = true;
+        break;
+
+    case Machine::Op2nnn:
+        emit({ 0x0F, 0xB7, 0x43, SP_OFFSET });       // movzx eax, word [rbx + SP]
+        emit({ 0x83, 0xE0, 0x0F });                  // and eax, 0xF
+        emit({ 0x66, 0x41, 0xC7, 0x04, 0x44 });      // mov word [r12 + rax * 2], return address
+        emit16(address + 2);
+        emit({ 0x66, 0xFF, 0x43, SP_OFFSET });       // inc word [rbx + SP]
+        emit_store_pc(nnn);
+        block_end = true;
+        break;
+
+    case Machine::Op3xkk:
+        emit({ 0x80, 0x7B, x, kk });                 // cmp byte [rbx + Vx], kk
+        emit_skip(0x75, address);                    // jne
+        block_end = true;
+        break;
+
+    case Machine::Op4xkk:
+        emit({ 0x80, 0x7B, x, kk });                 // cmp byte [rbx + Vx], kk
+        emit_skip(0x74, address);                    // je
+        block_end = true;
+        break;
+
+    case Machine::Op5xy0:
+        emit({ 0x8A, 0x43, x });                     // mov al, [rbx + Vx]
+        emit({ 0x3A, 0x43, y });                     // cmp al, [rbx + Vy]
+        emit_skip(0x75, address);                    // jne
+        block_end = true;
+        break;
+
+    case Machine::Op6xkk:
+        emit({ 0xC6, 0x43, x, kk });                 // mov byte [rbx + Vx], kk
+        break;
+
+    case Machine::Op7xkk:
+        emit({ 0x80, 0x43, x, kk });                 // add byte [rbx + Vx], kk
+        break;
+
+    case Machine::Op8xy0:
+        emit({ 0x8A, 0x43, y });                     // mov al, [rbx + Vy]
+        emit({ 0x88, 0x43, x });                     // mov [rbx + Vx], al
+        break;
+
+    case Machine::Op8xy1:
+        emit({ 0x8A, 0x43, y });                     // mov al, [rbx + Vy]
+        emit({ 0x08, 0x43, x });                     // or [rbx + Vx], al
+        if (m_quirks.logic_reset_vf)
+            emit({ 0xC6, 0x43, VF_OFFSET, 0x00 });   // mov byte [rbx + VF], 0
+        break;
+
+    case Machine::Op8xy2:
+        emit({ 0x8A, 0x43, y });                     // mov al, [rbx + Vy]
+        emit({ 0x20, 0x43, x });                     // and [rbx + Vx], al
+        if (m_quirks.logic_reset_vf)
+            emit({ 0xC6, 0x43, VF_OFFSET, 0x00 });   // mov byte [rbx + VF], 0
+        break;
+
+    case Machine::Op8xy3:
+        emit({ 0x8A, 0x43, y });                     // mov al, [rbx + Vy]
+        emit({ 0x30, 0x43, x });                     // xor [rbx + Vx], al
+        if (m_quirks.logic_reset_vf)
+            emit({ 0xC6, 0x43, VF_OFFSET, 0x00 });   // mov byte [rbx + VF], 0
+        break;
+
+    case Machine::Op8xy4:
+        emit({ 0x0F, 0xB6, 0x43, x });               // movzx eax, byte [rbx + Vx]
+        emit({ 0x0F, 0xB6, 0x4B, y });               // movzx ecx, byte [rbx + Vy]
+        emit({ 0x01, 0xC8 });                        // add eax, ecx
+        emit({ 0x3D }); emit32(0xFF);                // cmp eax, 0xFF
+        emit({ 0x0F, 0x97, 0xC2 });                  // seta dl
+        emit({ 0x88, 0x53, VF_OFFSET });             // mov [rbx + VF], dl
+        emit({ 0x8A, 0x43, x });                     // mov al, [rbx + Vx]
+        emit({ 0x02, 0x43, y });                     // add al, [rbx + Vy]
+        emit({ 0x88, 0x43, x });                     // mov [rbx + Vx], al
+        break;
+
+    case Machine::Op8xy5:
+        emit({ 0x8A, 0x43, x });                     // mov al, [rbx + Vx]
+        emit({ 0x3A, 0x43, y });                     // cmp al, [rbx + Vy]
+        emit({ 0x0F, 0x97, 0xC2 });                  // seta dl
+        emit({ 0x88, 0x53, VF_OFFSET });             // mov [rbx + VF], dl
+        emit({ 0x8A, 0x43, x });                     // mov al, [rbx + Vx]
+        emit({ 0x2A, 0x43, y });                     // sub al, [rbx + Vy]
+        emit({ 0x88, 0x43, x });                     // mov [rbx + Vx], al
+        break;
+
+    case Machine::Op8xy6:
+        emit({ 0x8A, 0x43, shift_source });          // mov al, [rbx + Vx or Vy]
+        emit({ 0x24, 0x01 });                        // and al, 1
+        emit({ 0x88, 0x43, VF_OFFSET });             // mov [rbx + VF], al
+        emit({ 0x8A, 0x43, shift_source });          // mov al, [rbx + Vx or Vy]
+        emit({ 0xD0, 0xE8 });                        // shr al, 1
+        emit({ 0x88, 0x43, x });                     // mov [rbx + Vx], al
+        break;
+
+    case Machine::Op8xy7:
+        emit({ 0x8A, 0x43, y });                     // mov al, [rbx + Vy]
+        emit({ 0x3A, 0x43, x });                     // cmp al, [rbx + Vx]
+        emit({ 0x0F, 0x97, 0xC2 });                  // seta dl
+        emit({ 0x88, 0x53, VF_OFFSET });             // mov [rbx + VF], dl
+        emit({ 0x8A, 0x43, y });                     // mov al, [rbx + Vy]
+        emit({ 0x2A, 0x43, x });                     // sub al, [rbx + Vx]
+        emit({ 0x88, 0x43, x });                     // mov [rbx + Vx], al
+        break;
+
+    case Machine::Op8xyE:
+        emit({ 0x8A, 0x43, shift_source });          // mov al, [rbx + Vx or Vy]
+        emit({ 0xC0, 0xE8, 0x07 });                  // shr al, 7
+        emit({ 0x88, 0x43, VF_OFFSET });             // mov [rbx + VF], al
+        emit({ 0x8A, 0x43, shift_source });          // mov al, [rbx + Vx or Vy]
+        emit({ 0x00, 0xC0 });                        // add al, al
+        emit({ 0x88, 0x43, x });                     // mov [rbx + Vx], al
+        break;
+
+    case Machine::Op9xy0:
+        emit({ 0x8A, 0x43, x });                     // mov al, [rbx + Vx]
+        emit({ 0x3A, 0x43, y });                     // cmp al, [rbx + Vy]
+        emit_skip(0x74, address);                    // je
+        block_end = true;
+        break;
+
+    case Machine::OpAnnn:
+        emit({ 0x66, 0xC7, 0x43, I_OFFSET });        // mov word [rbx + I], nnn
+        emit16(nnn);
+        break;
+
+    case Machine::OpBnnn:
+        emit({ 0x0F, 0xB6, 0x43, m_quirks.jump_vx ? x : V_OFFSET }); // movzx eax, byte [rbx + Vx or V0]
+        emit({ 0x05 }); emit32(nnn);                 // add eax, nnn
+        emit({ 0x66, 0x89, 0x43, PC_OFFSET });       // mov [rbx + PC], ax
+        block_end = true;
+        break;
+
+    case Machine::OpFx07:
+        emit({ 0x41, 0x8A, 0x45, 0x00 });            // mov al, [r13]
+        emit({ 0x88, 0x43, x });                     // mov [rbx + Vx], al
+        break;
+
+    case Machine::OpFx15:
+        emit({ 0x8A, 0x43, x });                     // mov al, [rbx + Vx]
+        emit({ 0x41, 0x88, 0x45, 0x00 });            // mov [r13], al
+        break;
+
+    case Machine::OpFx18:
+        emit({ 0x8A, 0x43, x });                     // mov al, [rbx + Vx]
+        emit({ 0x41, 0x88, 0x46, 0x00 });            // mov [r14], al
+        break;
+
+    case Machine::OpFx1E:
+        emit({ 0x0F, 0xB7, 0x43, I_OFFSET });        // movzx eax, word [rbx + I]
+        emit({ 0x0F, 0xB6, 0x4B, x });               // movzx ecx, byte [rbx + Vx]
+        emit({ 0x01, 0xC8 });                        // add eax, ecx
+        emit({ 0x3D }); emit32(0xFFF);               // cmp eax, 0xFFF
+        emit({ 0x0F, 0x97, 0xC2 });                  // seta dl
+        emit({ 0x88, 0x53, VF_OFFSET });             // mov [rbx + VF], dl
+        emit({ 0x0F, 0xB6, 0x4B, x });               // movzx ecx, byte [rbx + Vx]
+        emit({ 0x66, 0x01, 0x4B, I_OFFSET });        // add [rbx + I], cx
+        break;
+
+    case Machine::OpFx29:
+        emit({ 0x0F, 0xB6, 0x43, x });               // movzx eax, byte [rbx + Vx]
+        emit({ 0x8D, 0x04, 0x80 });                  // lea eax, [rax + rax * 4]
+        emit({ 0x66, 0x89, 0x43, I_OFFSET });        // mov [rbx + I], ax
+        break;
+
+    default:
+        // Left to the interpreter
+        return false;
+    }
+
+    return true;
+}
+
+void Jit::emit(std::initializer_list<uint8_t> bytes)
+{
+    m_emit.insert(m_emit.end(), bytes);
+}
+
+void Jit::emit16(uint16_t value)
+{
+    emit({ (uint8_t)value, (uint8_t)(value >> 8) });
+}
+
+void Jit::emit32(uint32_t value)
+{
+    emit({ (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) });
+}
+
+void Jit::emit_store_pc(uint16_t address)
+{
+    emit({ 0x66, 0xC7, 0x43, PC_OFFSET });           // mov word [rbx + PC], address
+    emit16(address);
+}
+
+void Jit::emit_skip(uint8_t jump_opcode, uint16_t address)
+{
+    // Flags come from the compare emitted by the caller, mov leaves them untouched
+    emit_store_pc(address + 2);
+    emit({ jump_opcode, 0x06 });                     // jcc over the next 6 byte store
+    emit_store_pc(address + 4);
+}
+
+bool Machine::jit_available()
+{
+    return true;
+}
+
+// Blocks run only when all their instructions fit before the next timer
+// tick, so timers are updated at exactly the same cycle as the interpreter.
+template <QuirkProfile Profile>
+void Machine::run_slice_jit(uint64_t slice_end)
+{
+    Jit::Context context { &m_registers, m_stack, &m_delay_timer, &m_sound_timer };
+
+    while (m_cycles < slice_end)
+    {
+        const uint16_t address = m_registers.PC;
+        if (m_jit && !(address & 1) && address < MemorySize)
+        {
+            const Jit::Block& block = m_jit->block(m_memory, address);
+            if (block.code && m_cycles + block.length <= slice_end)
+            {
+                block.code(&context);
+                m_cycles += block.length;
+                continue;
+            }
+        }
+
+        execute_cached_instruction<Profile>();
+        m_cycles++;
+
+        if (waiting<Profile>())
+            m_cycles = slice_end;
+    }
+}
+
+#else
+
+Jit::Jit() = default;
+Jit::~Jit() = default;
+
+void Jit::flush()
+{
+}
+
+void Jit::set_quirks(const Quirks& quirks)
+{
+    m_quirks = quirks;
+}
+
+void Jit::compile(const uint8_t* memory, uint16_t address)
+{
+    (void)memory;
+    m_blocks[address >> 1].compiled = true;
+}
+
+bool Machine::jit_available()
+{
+    return false;
+}
+
+template <QuirkProfile Profile>
+void Machine::run_slice_jit(uint64_t slice_end)
+{
+    run_slice<Profile, &Machine::execute_cached_instruction<Profile>>(slice_end);
+}
+
+#endif // CHIP8_JIT
+
+template void Machine::run_slice_jit<QuirkProfile::Modern>(uint64_t slice_end);
+template void Machine::run_slice_jit<QuirkProfile::Vip>(uint64_t slice_end);
+template void Machine::run_slice_jit<QuirkProfile::Schip>(uint64_t slice_end);
+template void Machine::run_slice_jit<QuirkProfile::XoChip>(uint64_t slice_end);
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "machine.hpp"
+
+// Dynamic recompiler translating CHIP-8 basic blocks to x86-64 code.
+//
+// A block starts at an even address and ends after a jump, call, return,
+// Bnnn or skip instruction, or before an instruction left to the
+// interpreter (drawing, keys, random, memory stores and loads). Blocks never
+// write memory, so the machine state matches the interpreter at every block
+// boundary. Compiled blocks are cached by address and all of them are
+// dropped when memory covered by a block is written. The quirks are emitted
+// into the code, changing them drops every block.
+class Jit
+{
+public:
+    struct Context
+    {
+        Machine::Registers* registers;
+        uint16_t* stack;
+        uint8_t* delay_timer;
+        uint8_t* sound_timer;
+    };
+
+    using BlockFunction = void (*)(Context* context);
+
+    struct Block
+    {
+        BlockFunction code = nullptr; // nullptr when the first instruction is not supported
+        uint16_t length = 0;          // Number of instructions
+        bool compiled = false;
+    };
+
+    static inline constexpr uint32_t MaxBlockLength = 64;
+    static inline constexpr size_t CodeBufferSize = 1024 * 1024;
+
+    Jit();
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    const Block& block(const uint8_t* memory, uint16_t address)
+    {
+        Block& entry = m_blocks[address >> 1];
+        if (!entry.compiled)
+            compile(memory, address);
+        return entry;
+    }
+
+    void invalidate(uint16_t address)
+    {
+        if (m_code_map[address & (Machine::MemorySize - 1)])
+            flush();
+    }
+
+    void flush();
+
+    void set_quirks(const Quirks& quirks);
+
+private:
+    Block m_blocks[Machine::MemorySize / 2];
+
+    // Non zero for every memory byte read by a compiled block
+    uint8_t m_code_map[Machine::MemorySize] = { 0 };
+
+    uint8_t* m_code = nullptr;
+    size_t m_code_used = 0;
+    size_t m_page_size = 4096;
+
+    std::vector<uint8_t> m_emit;
+    Quirks m_quirks;
+
+    void compile(const uint8_t* memory, uint16_t address);
+    bool emit_instruction(uint16_t value, uint16_t address, bool& block_end);
+
+    void emit(std::initializer_list<uint8_t> bytes);
+    void emit16(uint16_t value);
+    void emit32(uint32_t value);
+    void emit_store_pc(uint16_t address);
+    void emit_skip(uint8_t jump_opcode, uint16_t address);
+};
@@ -0,0 +1,547 @@
+#include "lockstep.hpp"
+#include "machine_ops.hpp"
+#include <algorithm>
+
+LockstepBatch::LockstepBatch(uint32_t lane_count)
+    : m_lanes(std::make_unique<Machine[]>(std::clamp<uint32_t>(lane_count, 1, MaxLanes)))
+    , m_lane_count(std::clamp<uint32_t>(lane_count, 1, MaxLanes))
+{
+}
+
+bool LockstepBatch::load_rom(const uint8_t* data, uint32_t size)
+{
+    for (uint32_t index = 0; index < m_lane_count; index++)
+    {
+        if (!m_lanes[index].load_rom(data, size))
+            return false;
+    }
+
+    return true;
+}
+
+void LockstepBatch::reset()
+{
+    for (uint32_t index = 0; index < m_lane_count; index++)
+        m_lanes[index].reset();
+}
+
+void LockstepBatch::set_instructions_per_second(uint32_t instructions_per_second)
+{
+    for (uint32_t index = 0; index < m_lane_count; index++)
+        m_lanes[index].set_instructions_per_second(instructions_per_second);
+}
+
+void LockstepBatch::set_quirk_profile(QuirkProfile profile)
+{
+    for (uint32_t index = 0; index < m_lane_count; index++)
+        m_lanes[index].set_quirk_profile(profile);
+}
+
+bool LockstepBatch::synchronized() const
+{
+    const Machine& first = m_lanes[0];
+    for (uint32_t index = 1; index < m_lane_count; index++)
+    {
+        const Machine& lane = m_lanes[index];
+        if (lane.m_cycles != first.m_cycles ||
+            lane.m_next_timer_cycle != first.m_next_timer_cycle ||
+            lane.m_timer_remainder != first.m_timer_remainder ||
+            lane.m_instructions_per_second != first.m_instructions_per_second ||
+            lane.m_quirk_profile != first.m_quirk_profile)
+            return false;
+    }
+
+    return true;
+}
+
+void LockstepBatch::run_cycles(uint64_t count)
+{
+    // Lanes run apart from the batch do not share the clock anymore
+    if (!synchronized())
+    {
+        for (uint32_t index = 0; index < m_lane_count; index++)
+            m_lanes[index].run_cycles(count);
+        return;
+    }
+
+    quirks::dispatch(m_lanes[0].m_quirk_profile, [&](auto profile)
+    {
+        run_cycles<decltype(profile)::value>(count);
+    });
+}
+
+template <QuirkProfile Profile>
+void LockstepBatch::run_cycles(uint64_t count)
+{
+    uint64_t cycles = m_lanes[0].m_cycles;
+    const uint64_t target = cycles + count;
+
+    while (cycles < target)
+    {
+        const uint64_t slice_end = std::min(target, m_lanes[0].m_next_timer_cycle);
+
+        if (m_group_count < 2)
+            form_group();
+        else
+            join_group();
+
+        run_slice<Profile>(cycles, slice_end);
+        cycles = slice_end;
+
+        for (uint32_t index = 0; index < m_lane_count; index++)
+        {
+            Machine& lane = m_lanes[index];
+            if (lane.m_cycles == lane.m_next_timer_cycle)
+            {
+                lane.update_timers();
+                lane.schedule_next_timer();
+            }
+        }
+    }
+
+    leave_group();
+}
+
+void LockstepBatch::run_frame()
+{
+    run_cycles(m_lanes[0].m_next_timer_cycle - m_lanes[0].m_cycles);
+}
+
+void LockstepBatch::load_registers(uint32_t lane)
+{
+    const Machine::Registers& registers = m_lanes[lane].m_registers;
+    for (uint32_t index = 0; index < 16; index++)
+        m_v[index][lane] = registers.V[index];
+    m_i[lane] = registers.I;
+}
+
+void LockstepBatch::store_registers(uint32_t lane)
+{
+    Machine::Registers& registers = m_lanes[lane].m_registers;
+    for (uint32_t index = 0; index < 16; index++)
+        registers.V[index] = m_v[index][lane];
+    registers.I = m_i[lane];
+}
+
+void LockstepBatch::form_group()
+{
+    leave_group();
+
+    // The PC shared by the most lanes, lanes waiting for the display sit out
+    // until the timer tick
+    uint32_t best_count = 0;
+    for (uint32_t index = 0; index < m_lane_count; index++)
+    {
+        const uint16_t pc = m_lanes[index].m_registers.PC;
+        if ((pc & 1) || pc >= Machine::MemorySize || m_lanes[index].m_waiting_for_display)
+            continue;
+
+        uint32_t count = 0;
+        for (uint32_t other = 0; other < m_lane_count; other++)
+        {
+            if (m_lanes[other].m_registers.PC == pc && !m_lanes[other].m_waiting_for_display)
+                count++;
+        }
+
+        if (count > best_count)
+        {
+            best_count = count;
+            m_pc = pc;
+        }
+    }
+
+    if (best_count >= 2)
+        join_group();
+}
+
+// Lanes that reached the group's PC at the start of a slice join it
+void LockstepBatch::join_group()
+{
+    for (uint32_t index = 0; index < m_lane_count; index++)
+    {
+        if (!m_grouped[index] && m_lanes[index].m_registers.PC == m_pc && !m_lanes[index].m_waiting_for_display)
+        {
+            m_grouped[index] = true;
+            m_group[m_group_count++] = index;
+            load_registers(index);
+        }
+    }
+}
+
+void LockstepBatch::leave_group()
+{
+    for (uint32_t position = 0; position < m_group_count; position++)
+    {
+        const uint32_t index = m_group[position];
+        store_registers(index);
+        m_lanes[index].m_registers.PC = m_pc;
+        m_grouped[index] = false;
+    }
+
+    m_group_count = 0;
+}
+
+// Hands the lane at a group position back to the cached engine for the rest of the slice
+template <QuirkProfile Profile>
+void LockstepBatch::release(uint32_t position, uint16_t pc, uint64_t cycles, uint64_t slice_end)
+{
+    const uint32_t index = m_group[position];
+    Machine& lane = m_lanes[index];
+
+    store_registers(index);
+    lane.m_registers.PC = pc;
+    lane.m_cycles = cycles;
+    m_grouped[index] = false;
+
+    if (lane.waiting<Profile>())
+        lane.m_cycles = slice_end;
+    else
+        lane.run_slice<Profile, &Machine::execute_cached_instruction<Profile>>(slice_end);
+}
+
+// Keeps the lanes going to the same PC as the first one still running
+template <QuirkProfile Profile>
+void LockstepBatch::settle(uint64_t cycles, uint64_t slice_end)
+{
+    uint32_t kept = 0;
+    for (uint32_t position = 0; position < m_group_count; position++)
+    {
+        const bool waiting = m_lanes[m_group[position]].waiting<Profile>();
+        if (waiting || (kept > 0 && m_next[position] != m_next[0]))
+        {
+            release<Profile>(position, m_next[position], cycles, slice_end);
+            continue;
+        }
+
+        m_group[kept] = m_group[position];
+        m_next[kept] = m_next[position];
+        kept++;
+    }
+
+    m_group_count = kept;
+    if (kept > 0)
+        m_pc = m_next[0];
+}
+
+template <QuirkProfile Profile>
+void LockstepBatch::run_slice(uint64_t cycles, uint64_t slice_end)
+{
+    // Lanes out of the group run the slice on their own, as Machine::run_cycles
+    // does a lane waiting for the display skips it
+    for (uint32_t index = 0; index < m_lane_count; index++)
+    {
+        Machine& lane = m_lanes[index];
+        if (m_grouped[index])
+            continue;
+
+        if (quirks::of(Profile).display_wait && lane.m_waiting_for_display)
+            lane.m_cycles = slice_end;
+        else
+            lane.run_slice<Profile, &Machine::execute_cached_instruction<Profile>>(slice_end);
+    }
+
+    while (cycles < slice_end && m_group_count > 1 && !(m_pc & 1) && m_pc < Machine::MemorySize)
+    {
+        Machine& leader = m_lanes[m_group[0]];
+        const uint16_t word = leader.read_word(m_pc);
+
+        // Lanes that wrote another instruction at PC leave before running it
+        uint32_t kept = 0;
+        for (uint32_t position = 0; position < m_group_count; position++)
+        {
+            if (m_lanes[m_group[position]].read_word(m_pc) != word)
+                release<Profile>(position, m_pc, cycles, slice_end);
+            else
+                m_group[kept++] = m_group[position];
+        }
+        m_group_count = kept;
+
+        Machine::DecodedInstruction& entry = leader.m_decoded[m_pc >> 1];
+        if (entry.op == Machine::OpDecode)
+            entry = Machine::decode<Profile>(word);
+
+        // Copied, the instruction may overwrite its own entry
+        const Machine::DecodedInstruction instruction = entry;
+
+        cycles++;
+        if (execute<Profile>(instruction))
+            settle<Profile>(cycles, slice_end);
+    }
+
+    // The group goes on in the next slice, the registers stay here
+    if (cycles == slice_end && m_group_count > 1)
+    {
+        for (uint32_t position = 0; position < m_group_count; position++)
+            m_lanes[m_group[position]].m_cycles = slice_end;
+        return;
+    }
+
+    // A single lane or an odd PC left, the slice ends on the cached engine
+    for (uint32_t position = 0; position < m_group_count; position++)
+        release<Profile>(position, m_pc, cycles, slice_end);
+
+    m_group_count = 0;
+}
+
+// Runs the instruction at m_pc for the group. Returns false when every lane
+// goes on at the updated m_pc, true when each lane left its next PC in m_next.
+template <QuirkProfile Profile>
+bool LockstepBatch::execute(const Machine::DecodedInstruction& instruction)
+{
+    const uint8_t x = instruction.x;
+    const uint8_t y = instruction.y;
+    const uint8_t kk = instruction.kk;
+    const uint16_t nnn = instruction.nnn;
+    const uint16_t next = m_pc + 2;
+    constexpr Quirks profile = quirks::of(Profile);
+    const uint8_t shift_source = profile.shift_vy ? y : x;
+
+    // Instructions touching more than the registers run the lane's own code,
+    // around it the lane copies in and out the registers that code uses
+    auto each_lane = [&](auto&& execute_lane)
+    {
+        for (uint32_t position = 0; position < m_group_count; position++)
+        {
+            const uint32_t index = m_group[position];
+            Machine& lane = m_lanes[index];
+
+            lane.m_registers.PC = next;
+            execute_lane(lane, lane.m_registers, index);
+            m_next[position] = lane.m_registers.PC;
+        }
+        return true;
+    };
+
+    auto skip_if = [&](auto&& condition)
+    {
+        for (uint32_t position = 0; position < m_group_count; position++)
+            m_next[position] = condition(m_group[position]) ? next + 2 : next;
+        return true;
+    };
+
+    switch (instruction.op)
+    {
+    case Machine::Op1nnn:
+        m_pc = nnn;
+        return false;
+
+    case Machine::Op2nnn:
+        for (uint32_t position = 0; position < m_group_count; position++)
+            m_lanes[m_group[position]].stack_push(next);
+        m_pc = nnn;
+        return false;
+
+    case Machine::Op00EE:
+        for (uint32_t position = 0; position < m_group_count; position++)
+            m_next[position] = m_lanes[m_group[position]].stack_pop();
+        return true;
+
+    case Machine::Op3xkk: return skip_if([&](uint32_t lane) { return m_v[x][lane] == kk; });
+    case Machine::Op4xkk: return skip_if([&](uint32_t lane) { return m_v[x][lane] != kk; });
+    case Machine::Op5xy0: return skip_if([&](uint32_t lane) { return m_v[x][lane] == m_v[y][lane]; });
+    case Machine::Op9xy0: return skip_if([&](uint32_t lane) { return m_v[x][lane] != m_v[y][lane]; });
+
+    case Machine::OpBnnn:
+        for (uint32_t position = 0; position < m_group_count; position++)
+            m_next[position] = nnn + m_v[profile.jump_vx ? nnn >> 8 : 0][m_group[position]];
+        return true;
+
+    // Register instructions run over every column, the ones of lanes out of the group are ignored
+    case Machine::Op6xkk:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+            m_v[x][lane] = kk;
+        break;
+
+    case Machine::Op7xkk:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+            m_v[x][lane] += kk;
+        break;
+
+    case Machine::Op8xy0:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+            m_v[x][lane] = m_v[y][lane];
+        break;
+
+    case Machine::Op8xy1:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+            m_v[x][lane] |= m_v[y][lane];
+        if constexpr (profile.logic_reset_vf)
+        {
+            for (uint32_t lane = 0; lane < MaxLanes; lane++)
+                m_v[0xF][lane] = 0;
+        }
+        break;
+
+    case Machine::Op8xy2:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+            m_v[x][lane] &= m_v[y][lane];
+        if constexpr (profile.logic_reset_vf)
+        {
+            for (uint32_t lane = 0; lane < MaxLanes; lane++)
+                m_v[0xF][lane] = 0;
+        }
+        break;
+
+    case Machine::Op8xy3:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+            m_v[x][lane] ^= m_v[y][lane];
+        if constexpr (profile.logic_reset_vf)
+        {
+            for (uint32_t lane = 0; lane < MaxLanes; lane++)
+                m_v[0xF][lane] = 0;
+        }
+        break;
+
+    case Machine::Op8xy4:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+        {
+            m_v[0xF][lane] = (((uint16_t)m_v[x][lane] + (uint16_t)m_v[y][lane]) > 0xFF) ? 1 : 0;
+            m_v[x][lane] += m_v[y][lane];
+        }
+        break;
+
+    case Machine::Op8xy5:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+        {
+            m_v[0xF][lane] = (m_v[x][lane] > m_v[y][lane]) ? 1 : 0;
+            m_v[x][lane] -= m_v[y][lane];
+        }
+        break;
+
+    case Machine::Op8xy6:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+        {
+            m_v[0xF][lane] = m_v[shift_source][lane] & 1;
+            m_v[x][lane] = m_v[shift_source][lane] >> 1;
+        }
+        break;
+
+    case Machine::Op8xy7:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+        {
+            m_v[0xF][lane] = (m_v[y][lane] > m_v[x][lane]) ? 1 : 0;
+            m_v[x][lane] = m_v[y][lane] - m_v[x][lane];
+        }
+        break;
+
+    case Machine::Op8xyE:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+        {
+            m_v[0xF][lane] = (m_v[shift_source][lane] >> 7) & 1;
+            m_v[x][lane] = m_v[shift_source][lane] << 1;
+        }
+        break;
+
+    case Machine::OpAnnn:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+            m_i[lane] = nnn;
+        break;
+
+    case Machine::OpFx1E:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+        {
+            m_v[0xF][lane] = ((m_i[lane] + m_v[x][lane]) > 0xFFF) ? 1 : 0;
+            m_i[lane] += m_v[x][lane];
+        }
+        break;
+
+    case Machine::OpFx29:
+        for (uint32_t lane = 0; lane < MaxLanes; lane++)
+            m_i[lane] = m_v[x][lane] * 5;
+        break;
+
+    case Machine::OpFx07:
+        for (uint32_t position = 0; position < m_group_count; position++)
+            m_v[x][m_group[position]] = m_lanes[m_group[position]].m_delay_timer;
+        break;
+
+    case Machine::OpFx15:
+        for (uint32_t position = 0; position < m_group_count; position++)
+            m_lanes[m_group[position]].m_delay_timer = m_v[x][m_group[position]];
+        break;
+
+    case Machine::OpFx18:
+        for (uint32_t position = 0; position < m_group_count; position++)
+            m_lanes[m_group[position]].m_sound_timer = m_v[x][m_group[position]];
+        break;
+
+    case Machine::Op00E0:
+        return each_lane([&](Machine& lane, Machine::Registers&, uint32_t)
+        {
+            lane.op_00e0();
+        });
+
+    case Machine::OpCxkk:
+        return each_lane([&](Machine& lane, Machine::Registers& registers, uint32_t column)
+        {
+            lane.op_cxkk(x, kk);
+            m_v[x][column] = registers.V[x];
+        });
+
+    case Machine::OpDxyn:
+        return each_lane([&](Machine& lane, Machine::Registers& registers, uint32_t column)
+        {
+            registers.V[x] = m_v[x][column];
+            registers.V[y] = m_v[y][column];
+            registers.I = m_i[column];
+            lane.op_dxyn<Profile>(x, y, kk & 0x0F);
+            m_v[0xF][column] = registers.V[0xF];
+        });
+
+    case Machine::OpEx9E:
+        return each_lane([&](Machine& lane, Machine::Registers& registers, uint32_t column)
+        {
+            registers.V[x] = m_v[x][column];
+            lane.op_ex9e(x);
+        });
+
+    case Machine::OpExA1:
+        return each_lane([&](Machine& lane, Machine::Registers& registers, uint32_t column)
+        {
+            registers.V[x] = m_v[x][column];
+            lane.op_exa1(x);
+        });
+
+    case Machine::OpFx0A:
+        return each_lane([&](Machine& lane, Machine::Registers& registers, uint32_t column)
+        {
+            registers.V[x] = m_v[x][column];
+            lane.op_fx0a(x);
+            m_v[x][column] = registers.V[x];
+        });
+
+    case Machine::OpFx33:
+        return each_lane([&](Machine& lane, Machine::Registers& registers, uint32_t column)
+        {
+            registers.V[x] = m_v[x][column];
+            registers.I = m_i[column];
+            lane.op_fx33(x);
+        });
+
+    case Machine::OpFx55:
+        return each_lane([&](Machine& lane, Machine::Registers& registers, uint32_t column)
+        {
+            for (uint32_t index = 0; index <= x; index++)
+                registers.V[index] = m_v[index][column];
+            registers.I = m_i[column];
+            lane.op_fx55<Profile>(x);
+            m_i[column] = registers.I;
+        });
+
+    case Machine::OpFx65:
+        return each_lane([&](Machine& lane, Machine::Registers& registers, uint32_t column)
+        {
+            registers.I = m_i[column];
+            lane.op_fx65<Profile>(x);
+            for (uint32_t index = 0; index <= x; index++)
+                m_v[index][column] = registers.V[index];
+            m_i[column] = registers.I;
+        });
+
+    default:
+        break;
+    }
+
+    m_pc = next;
+    return false;
+}
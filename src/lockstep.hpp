@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include "machine.hpp"
+
+// Runs several machines on the same clock, usually copies of one ROM fed
+// with different inputs.
+//
+// Lanes at the same PC form a group that steps together: the instruction is
+// fetched and decoded once and register instructions run over the V and I
+// registers of all lanes stored side by side, one column per lane, so that
+// they compile to vector code. Memory, display, stack, timers and keys stay in
+// each lane's Machine and use its own instruction code. A lane leaves the
+// group when its next PC differs from the group's and runs the rest of the
+// timer slice with the cached engine, lanes at the group's PC join it again
+// when a slice starts. Each lane ends in the same state as a Machine run on
+// its own.
+class LockstepBatch
+{
+public:
+    static inline constexpr uint32_t MaxLanes = 16;
+
+    explicit LockstepBatch(uint32_t lane_count);
+
+    uint32_t lane_count() const { return m_lane_count; }
+    Machine& lane(uint32_t index) { return m_lanes[index]; }
+    const Machine& lane(uint32_t index) const { return m_lanes[index]; }
+
+    bool load_rom(const uint8_t* data, uint32_t size);
+    void reset();
+    void set_instructions_per_second(uint32_t instructions_per_second);
+    void set_quirk_profile(QuirkProfile profile);
+
+    // Same as Machine::run_cycles and Machine::run_frame for every lane
+    void run_cycles(uint64_t count);
+    void run_frame();
+
+private:
+    std::unique_ptr<Machine[]> m_lanes;
+    uint32_t m_lane_count = 0;
+
+    // Registers of the grouped lanes, indexed by register then lane
+    alignas(16) uint8_t m_v[16][MaxLanes] = { };
+    alignas(16) uint16_t m_i[MaxLanes] = { };
+
+    // Lanes of the group and the PC each one reached, by position in the group
+    uint32_t m_group[MaxLanes] = { };
+    bool m_grouped[MaxLanes] = { };
+    uint16_t m_next[MaxLanes] = { };
+    uint32_t m_group_count = 0;
+    uint16_t m_pc = 0;
+
+    bool synchronized() const;
+    template <QuirkProfile Profile>
+    void run_cycles(uint64_t count);
+    template <QuirkProfile Profile>
+    void run_slice(uint64_t cycles, uint64_t slice_end);
+    void form_group();
+    void join_group();
+    void leave_group();
+    void load_registers(uint32_t lane);
+    void store_registers(uint32_t lane);
+    template <QuirkProfile Profile>
+    void release(uint32_t position, uint16_t pc, uint64_t cycles, uint64_t slice_end);
+    template <QuirkProfile Profile>
+    void settle(uint64_t cycles, uint64_t slice_end);
+    template <QuirkProfile Profile>
+    bool execute(const Machine::DecodedInstruction& instruction);
+};
@@ -0,0 +1,417 @@
+#include "machine.hpp"
+#include "machine_ops.hpp"
+#include <algorithm>
+#include <cstring>
+
+static NullVideoBackend null_video;
+static NullAudioBackend null_audio;
+static NullInputBackend null_input;
+
+// Font data
+uint8_t Machine::m_font[Machine::FontSize] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0,
+    0x20, 0x60, 0x20, 0x20, 0x70,
+    0xF0, 0x10, 0xF0, 0x80, 0xF0,
+    0xF0, 0x10, 0xF0, 0x10, 0xF0,
+    0x90, 0x90, 0xF0, 0x10, 0x10,
+    0xF0, 0x80, 0xF0, 0x10, 0xF0,
+    0xF0, 0x80, 0xF0, 0x90, 0xF0,
+    0xF0, 0x10, 0x20, 0x40, 0x40,
+    0xF0, 0x90, 0xF0, 0x90, 0xF0,
+    0xF0, 0x90, 0xF0, 0x10, 0xF0,
+    0xF0, 0x90, 0xF0, 0x90, 0x90,
+    0xE0, 0x90, 0xE0, 0x90, 0xE0,
+    0xF0, 0x80, 0x80, 0x80, 0xF0,
+    0xE0, 0x90, 0x90, 0x90, 0xE0,
+    0xF0, 0x80, 0xF0, 0x80, 0xF0,
+    0xF0, 0x80, 0xF0, 0x80, 0x80
+};
+
+Machine::Machine()
+{
+    set_video(nullptr);
+    set_audio(nullptr);
+    set_input(nullptr);
+    invalidate_decoded();
+}
+
+Machine::~Machine() = default;
+
+void Machine::set_engine(Engine engine)
+{
+    if (engine == Engine::Jit && !m_jit && jit_available())
+    {
+        m_jit = std::make_unique<Jit>();
+        m_jit->set_quirks(quirks::of(m_quirk_profile));
+    }
+
+    m_engine = engine;
+}
+
+bool Machine::engine_from_name(const char* name, Engine& engine)
+{
+    static const struct { const char* name; Engine engine; } engines[] = {
+        { "switch", Engine::Switch },
+        { "cached", Engine::Cached },
+        { "threaded", Engine::Threaded },
+        { "table", Engine::Table },
+        { "jit", Engine::Jit },
+    };
+
+    for (const auto& entry : engines)
+    {
+        if (std::strcmp(entry.name, name) == 0)
+        {
+            engine = entry.engine;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Machine::set_quirk_profile(QuirkProfile profile)
+{
+    if (profile == m_quirk_profile)
+        return;
+
+    // Decoded handlers and compiled blocks belong to the old profile
+    m_quirk_profile = profile;
+    m_waiting_for_display = false;
+    if (m_jit)
+        m_jit->set_quirks(quirks::of(profile));
+    invalidate_decoded();
+}
+
+void Machine::set_video(VideoBackend* video)
+{
+    m_video = video ? video : &null_video;
+}
+
+void Machine::set_audio(AudioBackend* audio)
+{
+    m_audio = audio ? audio : &null_audio;
+}
+
+void Machine::set_input(InputBackend* input)
+{
+    m_input = input ? input : &null_input;
+}
+
+bool Machine::load_rom(const uint8_t* data, uint32_t size)
+{
+    if ((MemorySize - ResetVector) < size)
+        return false;
+
+    std::memcpy(m_memory + ResetVector, data, size);
+    invalidate_decoded();
+    reset();
+
+    return true;
+}
+
+void Machine::reset()
+{
+    m_registers.PC = ResetVector;
+    m_registers.SP = 0x00;
+    m_registers.I = 0x00;
+    m_delay_timer = 0;
+    m_sound_timer = 0;
+    m_waiting_for_key = false;
+    m_waiting_for_display = false;
+
+    m_cycles = 0;
+    m_next_timer_cycle = 0;
+    m_timer_remainder = 0;
+    schedule_next_timer();
+
+    m_random_state = m_seed;
+
+    m_opcode.type = 0;
+    m_opcode.x = 0;
+    m_opcode.y = 0;
+    m_opcode.n = 0;
+    m_opcode.kk = 0;
+    m_opcode.nnn = 0;
+
+    for (int index = 0; index < 16; index++)
+        m_registers.V[index] = 0x00;
+
+    std::memset(m_stack, 0x00, sizeof(m_stack));
+    std::memset(m_display, 0x00, sizeof(m_display));
+    m_dirty_rows = AllDisplayRows;
+}
+
+void Machine::set_seed(uint64_t seed)
+{
+    m_seed = seed;
+    m_random_state = seed;
+}
+
+void Machine::clear_memory()
+{
+    std::memset(m_memory, 0x00, sizeof(m_memory));
+    invalidate_decoded();
+}
+
+void Machine::present()
+{
+    if (m_dirty_rows == 0)
+        return;
+
+    m_video->update_display(m_display, m_dirty_rows);
+    m_dirty_rows = 0;
+}
+
+void Machine::write_memory(uint16_t address, uint8_t value)
+{
+    write(address & 0xFFF, value);
+}
+
+uint64_t Machine::hash() const
+{
+    // FNV-1a
+    uint64_t value = 0xCBF29CE484222325ull;
+    auto hash_bytes = [&value](const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t index = 0; index < size; index++)
+        {
+            value ^= bytes[index];
+            value *= 0x100000001B3ull;
+        }
+    };
+
+    hash_bytes(&m_registers.PC, sizeof(m_registers.PC));
+    hash_bytes(&m_registers.SP, sizeof(m_registers.SP));
+    hash_bytes(&m_registers.I, sizeof(m_registers.I));
+    hash_bytes(m_registers.V, sizeof(m_registers.V));
+    hash_bytes(m_memory, sizeof(m_memory));
+    hash_bytes(m_stack, sizeof(m_stack));
+    hash_bytes(m_display, sizeof(m_display));
+    hash_bytes(&m_delay_timer, sizeof(m_delay_timer));
+    hash_bytes(&m_sound_timer, sizeof(m_sound_timer));
+    hash_bytes(&m_random_state, sizeof(m_random_state));
+
+    return value;
+}
+
+void Machine::fetch()
+{
+    uint16_t value = read_word(m_registers.PC);
+
+    // Decode instruction
+    m_opcode.type = (value >> 12) & 0x000F;
+    m_opcode.x = (value >> 8) & 0x000F;
+    m_opcode.y = (value >> 4) & 0x000F;
+    m_opcode.n = value & 0x000F;
+    m_opcode.kk = value & 0x00FF;
+    m_opcode.nnn = value & 0x0FFF;
+
+    // Increment program counter
+    m_registers.PC += 2;
+}
+
+void Machine::execute_next_instruction()
+{
+    quirks::dispatch(m_quirk_profile, [this](auto profile)
+    {
+        execute_next_instruction<decltype(profile)::value>();
+    });
+}
+
+void Machine::invalidate_decoded()
+{
+    for (auto& instruction : m_decoded)
+    {
+        instruction.handler = &Machine::decode_and_execute;
+        instruction.op = OpDecode;
+    }
+
+    if (m_jit)
+        m_jit->flush();
+}
+
+// Stored for entries not decoded yet, memory writes don't know the profile
+// the entry gets decoded for
+void Machine::decode_and_execute(Machine& machine, const DecodedInstruction& instruction)
+{
+    DecodedInstruction& entry = machine.m_decoded[&instruction - machine.m_decoded];
+    const uint16_t value = machine.read_word(machine.m_registers.PC - 2);
+
+    quirks::dispatch(machine.m_quirk_profile, [&](auto profile)
+    {
+        entry = decode<decltype(profile)::value>(value);
+    });
+    entry.handler(machine, entry);
+}
+
+void Machine::set_instructions_per_second(uint32_t instructions_per_second)
+{
+    // At least one instruction per timer tick
+    if (instructions_per_second < TimerFrequency)
+        instructions_per_second = TimerFrequency;
+
+    m_instructions_per_second = instructions_per_second;
+}
+
+void Machine::run_cycles(uint64_t count)
+{
+    quirks::dispatch(m_quirk_profile, [this, count](auto profile)
+    {
+        run_cycles<decltype(profile)::value>(count);
+    });
+}
+
+template <QuirkProfile Profile>
+void Machine::run_cycles(uint64_t count)
+{
+    const uint64_t target = m_cycles + count;
+
+    while (m_cycles < target)
+    {
+        const uint64_t slice_end = std::min(target, m_next_timer_cycle);
+
+        // A draw waiting for the timer tick ends every slice before it
+        if (quirks::of(Profile).display_wait && m_waiting_for_display)
+            m_cycles = slice_end;
+        else if (m_idle_skip)
+            skip_idle_loop(slice_end);
+
+        switch (m_engine)
+        {
+        case Engine::Switch:
+            run_slice<Profile, &Machine::execute_next_instruction<Profile>>(slice_end);
+            break;
+
+        case Engine::Cached:
+            run_slice<Profile, &Machine::execute_cached_instruction<Profile>>(slice_end);
+            break;
+
+        case Engine::Threaded:
+            run_slice_threaded<Profile>(slice_end);
+            break;
+
+        case Engine::Table:
+            run_slice_table<Profile>(slice_end);
+            break;
+
+        case Engine::Jit:
+            run_slice_jit<Profile>(slice_end);
+            break;
+
+        case Engine::Static:
+            // The runner was translated for one profile, see chip8_recompile
+            if (m_static_runner)
+                m_static_runner(*this, slice_end);
+            else
+                run_slice<Profile, &Machine::execute_cached_instruction<Profile>>(slice_end);
+            break;
+        }
+
+        if (m_cycles == m_next_timer_cycle)
+        {
+            update_timers();
+            schedule_next_timer();
+        }
+    }
+}
+
+// Matches a loop that waits on the delay timer without running it:
+//   A:     Fx07        Vx = delay timer
+//   A + 2: 3xkk/4xkk   leaves the loop once Vx is (3) or is not (4) kk
+//   A + 4: 1nnn        back to A
+// The delay timer only changes at the tick, so when a pass from A does not
+// leave the loop every pass until the tick ends in the same state and the
+// clock jumps over them. PC may be anywhere in the loop, the slice before
+// ended with a partial pass. The engine runs the last partial pass.
+void Machine::skip_idle_loop(uint64_t slice_end)
+{
+    for (uint16_t start = m_registers.PC, phase = 0; phase < 3; phase++, start -= 2)
+    {
+        const uint16_t load = read_word(start);
+        const uint16_t test = read_word(start + 2);
+        const uint16_t jump = read_word(start + 4);
+        const uint8_t x = (load >> 8) & 0x0F;
+
+        if ((load & 0xF0FF) != 0xF007 || jump != (0x1000 | (start & 0x0FFF)) ||
+            ((test & 0xF000) != 0x3000 && (test & 0xF000) != 0x4000) || ((test >> 8) & 0x0F) != x)
+            continue;
+
+        const uint8_t kk = test & 0xFF;
+        const bool leave_on_equal = (test & 0xF000) == 0x3000;
+
+        // Finish the pass in progress, unless it leaves the loop
+        if (phase == 1)
+        {
+            if ((m_registers.V[x] == kk) == leave_on_equal || m_cycles + 2 > slice_end)
+                return;
+            m_cycles += 2;
+        }
+        else if (phase == 2)
+        {
+            if (m_cycles + 1 > slice_end)
+                return;
+            m_cycles++;
+        }
+
+        m_registers.PC = start;
+        if ((m_delay_timer == kk) == leave_on_equal)
+            return;
+
+        const uint64_t passes = (slice_end - m_cycles) / 3;
+        if (passes > 0)
+        {
+            m_registers.V[x] = m_delay_timer;
+            m_cycles += passes * 3;
+        }
+        return;
+    }
+}
+
+void Machine::run_frame()
+{
+    run_cycles(m_next_timer_cycle - m_cycles);
+}
+
+void Machine::update_timers()
+{
+    m_waiting_for_display = false;
+
+    if (m_delay_timer > 0)
+        m_delay_timer--;
+
+    if (m_sound_timer > 0)
+    {
+        m_audio->set_sound(true, m_cycles);
+        m_sound_timer--;
+    }
+    else
+    {
+        m_audio->set_sound(false, m_cycles);
+    }
+}
+
+void Machine::schedule_next_timer()
+{
+    // Spread the remainder so that ticks stay exact for any speed
+    m_timer_remainder += m_instructions_per_second;
+    m_next_timer_cycle += m_timer_remainder / TimerFrequency;
+    m_timer_remainder %= TimerFrequency;
+}
+
+bool Machine::wait_key_press(uint8_t x)
+{
+    bool key_pressed = false;
+
+    for (uint32_t index = 0; index < KeyCount; index++)
+    {
+        if (m_input->is_key_pressed(index))
+        {
+            m_registers.V[x] = index;
+            key_pressed = true;
+        }
+    }
+
+    return key_pressed;
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include "backend.hpp"
+#include "quirks.hpp"
+
+class Jit;
+template <typename Program> class StaticProgram;
+
+class Machine
+{
+public:
+    Machine();
+    ~Machine();
+
+    struct Registers
+    {
+        uint16_t PC = 0x0000;
+        uint16_t SP = 0x0000;
+        uint16_t I = 0x0000;
+        uint8_t V[16] = { 0 };
+    };
+
+    struct Opcode
+    {
+        uint16_t type = 0x0000;
+        uint16_t x = 0x0000;
+        uint16_t y = 0x0000;
+        uint16_t n = 0x0000;
+        uint16_t kk = 0x0000;
+        uint16_t nnn = 0x0000;
+    };
+
+    static inline constexpr uint32_t MemorySize = 4096;
+    static inline constexpr uint32_t StackSize = 16;
+    static inline constexpr uint32_t FontSize = 80;
+    static inline constexpr uint32_t ResetVector = 0x200;
+    static inline constexpr uint32_t DisplayWidth = 64;
+    static inline constexpr uint32_t DisplayHeight = 32;
+    static inline constexpr uint32_t AllDisplayRows = 0xFFFFFFFF; // One dirty bit per row
+    static inline constexpr uint32_t KeyCount = 16;
+    static inline constexpr uint32_t TimerFrequency = 60;
+    static inline constexpr uint32_t DefaultInstructionsPerSecond = 720;
+
+    enum class Engine
+    {
+        Switch,  // Decode and dispatch through nested switches on every instruction
+        Cached,  // Call the handler stored in the predecoded instruction cache
+        Threaded, // Jump between handlers of predecoded instructions (computed goto when available)
+        Table,    // Call the handler of the raw opcode from a table generated at compile time
+        Jit,      // Run basic blocks recompiled to x86-64, the cached engine when the JIT is not built
+        Static    // Run the ROM translated to C++ by chip8_recompile, the cached engine when none is set
+    };
+
+    // Slice runner emitted by chip8_recompile, returns when the cycle count reaches slice_end
+    using StaticRunner = void (*)(Machine& machine, uint64_t slice_end);
+
+    // Passing nullptr restores the null backend
+    void set_video(VideoBackend* video);
+    void set_audio(AudioBackend* audio);
+    void set_input(InputBackend* input);
+
+    bool load_rom(const uint8_t* data, uint32_t size);
+    void reset();
+    void clear_memory();
+
+    void set_engine(Engine engine);
+    Engine engine() const { return m_engine; }
+
+    // Command line names "switch", "cached", "threaded", "table" and "jit"
+    static bool engine_from_name(const char* name, Engine& engine);
+    void set_static_runner(StaticRunner runner) { m_static_runner = runner; }
+
+    // Emulated speed, the 60 Hz timers tick every instructions_per_second / 60 cycles
+    void set_instructions_per_second(uint32_t instructions_per_second);
+    uint32_t instructions_per_second() const { return m_instructions_per_second; }
+    uint64_t cycles() const { return m_cycles; }
+
+    // Skip the passes of Fx07 / 3xkk or 4xkk / 1nnn loops that wait on the
+    // delay timer, off by default. The headless tools turn it on.
+    void set_idle_skip(bool enabled) { m_idle_skip = enabled; }
+    bool idle_skip() const { return m_idle_skip; }
+
+    // Instruction behaviours of the CHIP-8 variants, Modern by default. Every
+    // engine is built once per profile. Sprites start at their position modulo
+    // the display size, the profile clips or wraps the pixels past the edges.
+    void set_quirk_profile(QuirkProfile profile);
+    QuirkProfile quirk_profile() const { return m_quirk_profile; }
+
+    // Seed of the Cxkk random generator, reset() restarts its sequence
+    void set_seed(uint64_t seed);
+    uint64_t seed() const { return m_seed; }
+
+    void execute_next_instruction();
+
+    // Run count cycles on the virtual clock, timers tick at their emulated time.
+    // While waiting for a key press (Fx0A) the clock skips to the next timer tick.
+    void run_cycles(uint64_t count);
+
+    // Run until the next timer tick
+    void run_frame();
+
+    // Send the display and its changed rows to the video backend if any changed
+    void present();
+
+    // Write a byte from outside the machine (debugger, tools)
+    void write_memory(uint16_t address, uint8_t value);
+
+    // Versioned binary snapshot of the machine, the engine and the backends are not part of it.
+    // save_state returns the bytes written, 0 when size is below SaveStateSize.
+    // The decoded opcode is scratch of the switch engine and is not saved.
+    static inline constexpr uint32_t SaveStateVersion = 3;
+    static inline constexpr uint32_t SaveStateSize = 4459;
+    uint32_t save_state(uint8_t* data, uint32_t size) const;
+    bool load_state(const uint8_t* data, uint32_t size);
+
+    // Hash of the architectural state, equal for all engines after the same cycles
+    uint64_t hash() const;
+
+    const Registers& registers() const { return m_registers; }
+    const Opcode& opcode() const { return m_opcode; }
+    const uint8_t* memory() const { return m_memory; }
+    // One row per display line, the leftmost pixel in the most significant bit
+    const uint64_t* display() const { return m_display; }
+    uint8_t delay_timer() const { return m_delay_timer; }
+    uint8_t sound_timer() const { return m_sound_timer; }
+    bool waiting_for_key() const { return m_waiting_for_key; }
+
+    static bool jit_available();
+
+private:
+    friend class Jit;
+    friend class LockstepBatch;
+    friend class OpcodeTable;
+    template <typename Program> friend class StaticProgram;
+
+    // Instruction kinds of the predecoded cache, OpDecode marks an entry not decoded yet
+    enum Op : uint8_t
+    {
+        OpDecode, OpNop,
+        Op00E0, Op00EE, Op1nnn, Op2nnn, Op3xkk, Op4xkk, Op5xy0, Op6xkk, Op7xkk,
+        Op8xy0, Op8xy1, Op8xy2, Op8xy3, Op8xy4, Op8xy5, Op8xy6, Op8xy7, Op8xyE,
+        Op9xy0, OpAnnn, OpBnnn, OpCxkk, OpDxyn, OpEx9E, OpExA1,
+        OpFx07, OpFx0A, OpFx15, OpFx18, OpFx1E, OpFx29, OpFx33, OpFx55, OpFx65,
+        OpCount
+    };
+
+    struct DecodedInstruction;
+    using Handler = void (*)(Machine& machine, const DecodedInstruction& instruction);
+
+    // Predecoded instruction, one entry per even address
+    struct DecodedInstruction
+    {
+        Handler handler = nullptr;
+        uint8_t op = OpDecode;
+        uint8_t x = 0;
+        uint8_t y = 0;
+        uint8_t kk = 0; // n is the low nibble
+        uint16_t nnn = 0;
+    };
+
+    static inline constexpr uint32_t DecodedSize = MemorySize / 2;
+
+    template <QuirkProfile Profile>
+    static const Handler m_handlers[OpCount];
+
+    VideoBackend* m_video = nullptr;
+    AudioBackend* m_audio = nullptr;
+    InputBackend* m_input = nullptr;
+
+    Registers m_registers;
+    Opcode m_opcode;
+
+    uint8_t m_memory[MemorySize] = { 0 };
+    uint16_t m_stack[StackSize] = { 0 };
+    uint64_t m_display[DisplayHeight] = { 0 };
+    uint32_t m_dirty_rows = 0; // Rows changed since the last present
+    static_assert(DisplayHeight <= 32, "Dirty rows do not fit the mask");
+    uint8_t m_delay_timer = 0;
+    uint8_t m_sound_timer = 0;
+    bool m_waiting_for_key = false;
+    bool m_waiting_for_display = false; // Until the next timer tick, cleared between frames
+
+    uint32_t m_instructions_per_second = DefaultInstructionsPerSecond;
+    uint64_t m_cycles = 0;
+    uint64_t m_next_timer_cycle = 0;
+    uint32_t m_timer_remainder = 0;
+
+    bool m_idle_skip = false;
+    QuirkProfile m_quirk_profile = QuirkProfile::Modern;
+
+    uint64_t m_seed = 0;
+    uint64_t m_random_state = 0;
+
+    Engine m_engine = Engine::Switch;
+    DecodedInstruction m_decoded[DecodedSize];
+    std::unique_ptr<Jit> m_jit;
+    StaticRunner m_static_runner = nullptr;
+
+    static uint8_t m_font[FontSize];
+
+    uint8_t read(uint16_t address);
+    uint16_t read_word(uint16_t address);
+    void write(uint16_t address, uint8_t value);
+    void stack_push(uint16_t value);
+    uint16_t stack_pop();
+    void fetch();
+    void update_timers();
+    void schedule_next_timer();
+
+    // The engines for one quirk profile, run_cycles picks them once per call
+    template <QuirkProfile Profile>
+    void run_cycles(uint64_t count);
+
+    void skip_idle_loop(uint64_t slice_end);
+
+    // True when the rest of the slice can be skipped
+    template <QuirkProfile Profile>
+    bool waiting() const;
+
+    template <QuirkProfile Profile, void (Machine::*Step)()>
+    void run_slice(uint64_t slice_end);
+
+    template <QuirkProfile Profile>
+    void execute_next_instruction();
+    template <QuirkProfile Profile>
+    void execute_cached_instruction();
+    template <QuirkProfile Profile>
+    void run_slice_threaded(uint64_t slice_end);
+    template <QuirkProfile Profile>
+    void execute_table_instruction();
+    template <QuirkProfile Profile>
+    void run_slice_table(uint64_t slice_end);
+    template <QuirkProfile Profile>
+    void run_slice_jit(uint64_t slice_end);
+
+    void invalidate_decoded();
+    static constexpr Op decode_op(uint16_t value);
+    template <QuirkProfile Profile>
+    static DecodedInstruction decode(uint16_t value);
+    static void decode_and_execute(Machine& machine, const DecodedInstruction& instruction);
+
+    uint8_t generate_random_byte();
+
+    bool wait_key_press(uint8_t x);
+
+    // Instruction semantics shared by all engines, defined in machine_ops.hpp.
+    // The ones variants disagree on take the quirk profile.
+    void op_00e0();
+    void op_00ee();
+    void op_1nnn(uint16_t nnn);
+    void op_2nnn(uint16_t nnn);
+    void op_3xkk(uint8_t x, uint8_t kk);
+    void op_4xkk(uint8_t x, uint8_t kk);
+    void op_5xy0(uint8_t x, uint8_t y);
+    void op_6xkk(uint8_t x, uint8_t kk);
+    void op_7xkk(uint8_t x, uint8_t kk);
+    void op_8xy0(uint8_t x, uint8_t y);
+    template <QuirkProfile Profile>
+    void op_8xy1(uint8_t x, uint8_t y);
+    template <QuirkProfile Profile>
+    void op_8xy2(uint8_t x, uint8_t y);
+    template <QuirkProfile Profile>
+    void op_8xy3(uint8_t x, uint8_t y);
+    void op_8xy4(uint8_t x, uint8_t y);
+    void op_8xy5(uint8_t x, uint8_t y);
+    template <QuirkProfile Profile>
+    void op_8xy6(uint8_t x, uint8_t y);
+    void op_8xy7(uint8_t x, uint8_t y);
+    template <QuirkProfile Profile>
+    void op_8xye(uint8_t x, uint8_t y);
+    void op_9xy0(uint8_t x, uint8_t y);
+    void op_annn(uint16_t nnn);
+    template <QuirkProfile Profile>
+    void op_bnnn(uint16_t nnn);
+    void op_cxkk(uint8_t x, uint8_t kk);
+    template <QuirkProfile Profile>
+    void op_dxyn(uint8_t x, uint8_t y, uint8_t n);
+    void op_ex9e(uint8_t x);
+    void op_exa1(uint8_t x);
+    void op_fx07(uint8_t x);
+    void op_fx0a(uint8_t x);
+    void op_fx15(uint8_t x);
+    void op_fx18(uint8_t x);
+    void op_fx1e(uint8_t x);
+    void op_fx29(uint8_t x);
+    void op_fx33(uint8_t x);
+    template <QuirkProfile Profile>
+    void op_fx55(uint8_t x);
+    template <QuirkProfile Profile>
+    void op_fx65(uint8_t x);
+};
@@ -0,0 +1,541 @@
+#pragma once
+
+// Memory access and instruction semantics of the machine, inlined into every
+// execution engine so all of them share one definition of each instruction.
+
+#include "machine.hpp"
+#include "jit_x64.hpp"
+#include <cstring>
+
+// Addresses past the end wrap around, PC gets there through Bnnn or by
+// running past 0xFFE and every engine fetches through here
+inline uint8_t Machine::read(uint16_t address)
+{
+    return m_memory[address & (MemorySize - 1)];
+}
+
+inline uint16_t Machine::read_word(uint16_t address)
+{
+    return (read(address) << 8 | read(address + 1));
+}
+
+inline void Machine::write(uint16_t address, uint8_t value)
+{
+    m_memory[address] = value;
+
+    // The byte belongs to the instruction starting at the even address below it
+    DecodedInstruction& instruction = m_decoded[(address >> 1) & (DecodedSize - 1)];
+    instruction.handler = &Machine::decode_and_execute;
+    instruction.op = OpDecode;
+
+    if (m_jit)
+        m_jit->invalidate(address);
+}
+
+// The stack index wraps around instead of running past the stack on overflow
+inline void Machine::stack_push(uint16_t value)
+{
+    m_stack[m_registers.SP & (StackSize - 1)] = value;
+    m_registers.SP++;
+}
+
+inline uint16_t Machine::stack_pop()
+{
+    m_registers.SP--;
+    return m_stack[m_registers.SP & (StackSize - 1)];
+}
+
+inline uint8_t Machine::generate_random_byte()
+{
+    // SplitMix64, any seed gives a full period sequence
+    uint64_t value = (m_random_state += 0x9E3779B97F4A7C15ull);
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return static_cast<uint8_t>((value ^ (value >> 31)) >> 56);
+}
+
+constexpr Machine::Op Machine::decode_op(uint16_t value)
+{
+    switch (value >> 12)
+    {
+    case 0x0:
+        if (value == 0x00E0)
+            return Op00E0;
+        if (value == 0x00EE)
+            return Op00EE;
+        break;
+
+    case 0x1: return Op1nnn;
+    case 0x2: return Op2nnn;
+    case 0x3: return Op3xkk;
+    case 0x4: return Op4xkk;
+    case 0x5: return Op5xy0;
+    case 0x6: return Op6xkk;
+    case 0x7: return Op7xkk;
+
+    case 0x8:
+        switch (value & 0x000F)
+        {
+        case 0x0: return Op8xy0;
+        case 0x1: return Op8xy1;
+        case 0x2: return Op8xy2;
+        case 0x3: return Op8xy3;
+        case 0x4: return Op8xy4;
+        case 0x5: return Op8xy5;
+        case 0x6: return Op8xy6;
+        case 0x7: return Op8xy7;
+        case 0xE: return Op8xyE;
+        }
+        break;
+
+    case 0x9: return Op9xy0;
+    case 0xA: return OpAnnn;
+    case 0xB: return OpBnnn;
+    case 0xC: return OpCxkk;
+    case 0xD: return OpDxyn;
+
+    case 0xE:
+        switch (value & 0x00FF)
+        {
+        case 0x9E: return OpEx9E;
+        case 0xA1: return OpExA1;
+        }
+        break;
+
+    case 0xF:
+        switch (value & 0x00FF)
+        {
+        case 0x07: return OpFx07;
+        case 0x0A: return OpFx0A;
+        case 0x15: return OpFx15;
+        case 0x18: return OpFx18;
+        case 0x1E: return OpFx1E;
+        case 0x29: return OpFx29;
+        case 0x33: return OpFx33;
+        case 0x55: return OpFx55;
+        case 0x65: return OpFx65;
+        }
+        break;
+    }
+
+    // Unknown instructions do nothing, like in the switch engine
+    return OpNop;
+}
+
+// Nothing changes until the key state is checked again or, with the display
+// wait quirk, until the timer tick after a draw
+template <QuirkProfile Profile>
+inline bool Machine::waiting() const
+{
+    if constexpr (quirks::of(Profile).display_wait)
+        return m_waiting_for_key || m_waiting_for_display;
+    else
+        return m_waiting_for_key;
+}
+
+template <QuirkProfile Profile, void (Machine::*Step)()>
+inline void Machine::run_slice(uint64_t slice_end)
+{
+    while (m_cycles < slice_end)
+    {
+        (this->*Step)();
+        m_cycles++;
+
+        if (waiting<Profile>())
+            m_cycles = slice_end;
+    }
+}
+
+inline void Machine::op_00e0()
+{
+    // Rows that were already blank stay clean
+    for (uint32_t row = 0; row < DisplayHeight; row++)
+    {
+        if (m_display[row] != 0)
+            m_dirty_rows |= 1u << row;
+        m_display[row] = 0;
+    }
+}
+
+inline void Machine::op_00ee()
+{
+    m_registers.PC = stack_pop();
+}
+
+inline void Machine::op_1nnn(uint16_t nnn)
+{
+    m_registers.PC = nnn;
+}
+
+inline void Machine::op_2nnn(uint16_t nnn)
+{
+    stack_push(m_registers.PC);
+    m_registers.PC = nnn;
+}
+
+inline void Machine::op_3xkk(uint8_t x, uint8_t kk)
+{
+    if (m_registers.V[x] == kk)
+        m_registers.PC += 2;
+}
+
+inline void Machine::op_4xkk(uint8_t x, uint8_t kk)
+{
+    if (m_registers.V[x] != kk)
+        m_registers.PC += 2;
+}
+
+inline void Machine::op_5xy0(uint8_t x, uint8_t y)
+{
+    if (m_registers.V[x] == m_registers.V[y])
+        m_registers.PC += 2;
+}
+
+inline void Machine::op_6xkk(uint8_t x, uint8_t kk)
+{
+    m_registers.V[x] = kk;
+}
+
+inline void Machine::op_7xkk(uint8_t x, uint8_t kk)
+{
+    m_registers.V[x] += kk;
+}
+
+inline void Machine::op_8xy0(uint8_t x, uint8_t y)
+{
+    m_registers.V[x] = m_registers.V[y];
+}
+
+template <QuirkProfile Profile>
+inline void Machine::op_8xy1(uint8_t x, uint8_t y)
+{
+    m_registers.V[x] |= m_registers.V[y];
+    if constexpr (quirks::of(Profile).logic_reset_vf)
+        m_registers.V[0xF] = 0;
+}
+
+template <QuirkProfile Profile>
+inline void Machine::op_8xy2(uint8_t x, uint8_t y)
+{
+    m_registers.V[x] &= m_registers.V[y];
+    if constexpr (quirks::of(Profile).logic_reset_vf)
+        m_registers.V[0xF] = 0;
+}
+
+template <QuirkProfile Profile>
+inline void Machine::op_8xy3(uint8_t x, uint8_t y)
+{
+    m_registers.V[x] ^= m_registers.V[y];
+    if constexpr (quirks::of(Profile).logic_reset_vf)
+        m_registers.V[0xF] = 0;
+}
+
+inline void Machine::op_8xy4(uint8_t x, uint8_t y)
+{
+    m_registers.V[0xF] = (((uint16_t)m_registers.V[x] + (uint16_t)m_registers.V[y]) > 0xFF) ? 1 : 0;
+    m_registers.V[x] += m_registers.V[y];
+}
+
+inline void Machine::op_8xy5(uint8_t x, uint8_t y)
+{
+    m_registers.V[0xF] = (m_registers.V[x] > m_registers.V[y]) ? 1 : 0;
+    m_registers.V[x] -= m_registers.V[y];
+}
+
+// VF is written before Vx, so in 8Fy6 and 8FyE the result replaces the
+// shifted flag. The source is read again after VF, a VF source shifts the flag.
+template <QuirkProfile Profile>
+inline void Machine::op_8xy6(uint8_t x, uint8_t y)
+{
+    const uint8_t source = quirks::of(Profile).shift_vy ? y : x;
+    m_registers.V[0xF] = m_registers.V[source] & 1;
+    m_registers.V[x] = m_registers.V[source] >> 1;
+}
+
+inline void Machine::op_8xy7(uint8_t x, uint8_t y)
+{
+    m_registers.V[0xF] = (m_registers.V[y] > m_registers.V[x]) ? 1 : 0;
+    m_registers.V[x] = m_registers.V[y] - m_registers.V[x];
+}
+
+template <QuirkProfile Profile>
+inline void Machine::op_8xye(uint8_t x, uint8_t y)
+{
+    const uint8_t source = quirks::of(Profile).shift_vy ? y : x;
+    m_registers.V[0xF] = (m_registers.V[source] >> 7) & 1;
+    m_registers.V[x] = m_registers.V[source] << 1;
+}
+
+inline void Machine::op_9xy0(uint8_t x, uint8_t y)
+{
+    if (m_registers.V[x] != m_registers.V[y])
+        m_registers.PC += 2;
+}
+
+inline void Machine::op_annn(uint16_t nnn)
+{
+    m_registers.I = nnn;
+}
+
+template <QuirkProfile Profile>
+inline void Machine::op_bnnn(uint16_t nnn)
+{
+    if constexpr (quirks::of(Profile).jump_vx)
+        m_registers.PC = nnn + m_registers.V[nnn >> 8];
+    else
+        m_registers.PC = nnn + m_registers.V[0];
+}
+
+inline void Machine::op_cxkk(uint8_t x, uint8_t kk)
+{
+    m_registers.V[x] = generate_random_byte() & kk;
+}
+
+template <QuirkProfile Profile>
+inline void Machine::op_dxyn(uint8_t x, uint8_t y, uint8_t n)
+{
+    constexpr bool wrap = quirks::of(Profile).sprite_wrap;
+
+    const uint32_t x_pos = m_registers.V[x] % DisplayWidth;
+    const uint32_t y_pos = m_registers.V[y] % DisplayHeight;
+
+    // Each sprite row is shifted into place and XORed into a display row at once
+    uint64_t collision = 0;
+    for (uint32_t row = 0; row < n; row++)
+    {
+        uint32_t line = y_pos + row;
+        if (line >= DisplayHeight)
+        {
+            if (!wrap)
+                break;
+            line -= DisplayHeight;
+        }
+
+        const uint64_t data = static_cast<uint64_t>(m_memory[(m_registers.I + row) & (MemorySize - 1)]) << 56;
+        uint64_t sprite = data >> x_pos;
+        if (wrap && x_pos != 0)
+            sprite |= data << (DisplayWidth - x_pos);
+
+        collision |= m_display[line] & sprite;
+        m_display[line] ^= sprite;
+        if (sprite != 0)
+            m_dirty_rows |= 1u << line;
+    }
+
+    m_registers.V[0xF] = collision != 0 ? 1 : 0;
+
+    if constexpr (quirks::of(Profile).display_wait)
+        m_waiting_for_display = true;
+}
+
+inline void Machine::op_ex9e(uint8_t x)
+{
+    if (m_input->is_key_pressed(m_registers.V[x] & 15))
+        m_registers.PC += 2;
+}
+
+inline void Machine::op_exa1(uint8_t x)
+{
+    if (!m_input->is_key_pressed(m_registers.V[x] & 15))
+        m_registers.PC += 2;
+}
+
+inline void Machine::op_fx07(uint8_t x)
+{
+    m_registers.V[x] = m_delay_timer;
+}
+
+inline void Machine::op_fx0a(uint8_t x)
+{
+    m_waiting_for_key = !wait_key_press(x);
+    if (m_waiting_for_key)
+        m_registers.PC -= 2;
+}
+
+inline void Machine::op_fx15(uint8_t x)
+{
+    m_delay_timer = m_registers.V[x];
+}
+
+inline void Machine::op_fx18(uint8_t x)
+{
+    m_sound_timer = m_registers.V[x];
+}
+
+inline void Machine::op_fx1e(uint8_t x)
+{
+    m_registers.V[0xF] = ((m_registers.I + m_registers.V[x]) > 0xFFF) ? 1 : 0;
+    m_registers.I += m_registers.V[x];
+}
+
+inline void Machine::op_fx29(uint8_t x)
+{
+    m_registers.I = m_registers.V[x] * 5;
+}
+
+inline void Machine::op_fx33(uint8_t x)
+{
+    write(m_registers.I & 0xFFF, (m_registers.V[x] % 1000) / 100);
+    write((m_registers.I + 1) & 0xFFF, (m_registers.V[x] / 10) % 10);
+    write((m_registers.I + 2) & 0xFFF, m_registers.V[x] % 10);
+}
+
+template <QuirkProfile Profile>
+inline void Machine::op_fx55(uint8_t x)
+{
+    for (int index = 0; index <= x; index++)
+        write((m_registers.I + index) & 0xFFF, m_registers.V[index]);
+
+    if constexpr (quirks::of(Profile).load_store_i)
+        m_registers.I += x + 1;
+}
+
+template <QuirkProfile Profile>
+inline void Machine::op_fx65(uint8_t x)
+{
+    for (int index = 0; index <= x; index++)
+        m_registers.V[index] = m_memory[(m_registers.I + index) & 0xFFF];
+
+    if constexpr (quirks::of(Profile).load_store_i)
+        m_registers.I += x + 1;
+}
+
+template <QuirkProfile Profile>
+const Machine::Handler Machine::m_handlers[Machine::OpCount] = {
+    &Machine::decode_and_execute,
+    [](Machine&, const DecodedInstruction&) {},
+    [](Machine& m, const DecodedInstruction&) { m.op_00e0(); },
+    [](Machine& m, const DecodedInstruction&) { m.op_00ee(); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_1nnn(i.nnn); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_2nnn(i.nnn); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_3xkk(i.x, i.kk); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_4xkk(i.x, i.kk); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_5xy0(i.x, i.y); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_6xkk(i.x, i.kk); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_7xkk(i.x, i.kk); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_8xy0(i.x, i.y); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_8xy1<Profile>(i.x, i.y); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_8xy2<Profile>(i.x, i.y); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_8xy3<Profile>(i.x, i.y); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_8xy4(i.x, i.y); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_8xy5(i.x, i.y); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_8xy6<Profile>(i.x, i.y); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_8xy7(i.x, i.y); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_8xye<Profile>(i.x, i.y); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_9xy0(i.x, i.y); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_annn(i.nnn); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_bnnn<Profile>(i.nnn); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_cxkk(i.x, i.kk); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_dxyn<Profile>(i.x, i.y, i.kk & 0x0F); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_ex9e(i.x); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_exa1(i.x); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_fx07(i.x); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_fx0a(i.x); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_fx15(i.x); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_fx18(i.x); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_fx1e(i.x); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_fx29(i.x); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_fx33(i.x); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_fx55<Profile>(i.x); },
+    [](Machine& m, const DecodedInstruction& i) { m.op_fx65<Profile>(i.x); }
+};
+
+template <QuirkProfile Profile>
+inline Machine::DecodedInstruction Machine::decode(uint16_t value)
+{
+    DecodedInstruction instruction;
+    instruction.op = decode_op(value);
+    instruction.handler = m_handlers<Profile>[instruction.op];
+    instruction.x = (value >> 8) & 0x000F;
+    instruction.y = (value >> 4) & 0x000F;
+    instruction.kk = value & 0x00FF;
+    instruction.nnn = value & 0x0FFF;
+
+    return instruction;
+}
+
+template <QuirkProfile Profile>
+inline void Machine::execute_next_instruction()
+{
+    fetch();
+
+    switch (m_opcode.type)
+    {
+    case 0x0:
+        switch (m_opcode.nnn)
+        {
+        case 0x0E0: op_00e0(); break;
+        case 0x0EE: op_00ee(); break;
+        }
+        break;
+
+    case 0x1: op_1nnn(m_opcode.nnn); break;
+    case 0x2: op_2nnn(m_opcode.nnn); break;
+    case 0x3: op_3xkk(m_opcode.x, m_opcode.kk); break;
+    case 0x4: op_4xkk(m_opcode.x, m_opcode.kk); break;
+    case 0x5: op_5xy0(m_opcode.x, m_opcode.y); break;
+    case 0x6: op_6xkk(m_opcode.x, m_opcode.kk); break;
+    case 0x7: op_7xkk(m_opcode.x, m_opcode.kk); break;
+
+    case 0x8:
+        switch (m_opcode.n)
+        {
+        case 0x0: op_8xy0(m_opcode.x, m_opcode.y); break;
+        case 0x1: op_8xy1<Profile>(m_opcode.x, m_opcode.y); break;
+        case 0x2: op_8xy2<Profile>(m_opcode.x, m_opcode.y); break;
+        case 0x3: op_8xy3<Profile>(m_opcode.x, m_opcode.y); break;
+        case 0x4: op_8xy4(m_opcode.x, m_opcode.y); break;
+        case 0x5: op_8xy5(m_opcode.x, m_opcode.y); break;
+        case 0x6: op_8xy6<Profile>(m_opcode.x, m_opcode.y); break;
+        case 0x7: op_8xy7(m_opcode.x, m_opcode.y); break;
+        case 0xE: op_8xye<Profile>(m_opcode.x, m_opcode.y); break;
+        }
+        break;
+
+    case 0x9: op_9xy0(m_opcode.x, m_opcode.y); break;
+    case 0xA: op_annn(m_opcode.nnn); break;
+    case 0xB: op_bnnn<Profile>(m_opcode.nnn); break;
+    case 0xC: op_cxkk(m_opcode.x, m_opcode.kk); break;
+    case 0xD: op_dxyn<Profile>(m_opcode.x, m_opcode.y, m_opcode.n); break;
+
+    case 0xE:
+        switch (m_opcode.kk)
+        {
+        case 0x9E: op_ex9e(m_opcode.x); break;
+        case 0xA1: op_exa1(m_opcode.x); break;
+        }
+        break;
+
+    case 0xF:
+        switch (m_opcode.kk)
+        {
+        case 0x07: op_fx07(m_opcode.x); break;
+        case 0x0A: op_fx0a(m_opcode.x); break;
+        case 0x15: op_fx15(m_opcode.x); break;
+        case 0x18: op_fx18(m_opcode.x); break;
+        case 0x1E: op_fx1e(m_opcode.x); break;
+        case 0x29: op_fx29(m_opcode.x); break;
+        case 0x33: op_fx33(m_opcode.x); break;
+        case 0x55: op_fx55<Profile>(m_opcode.x); break;
+        case 0x65: op_fx65<Profile>(m_opcode.x); break;
+        }
+        break;
+    }
+}
+
+template <QuirkProfile Profile>
+inline void Machine::execute_cached_instruction()
+{
+    const uint16_t address = m_registers.PC;
+
+    // Odd addresses are rare and not cached
+    if ((address & 1) || address >= MemorySize)
+    {
+        execute_next_instruction<Profile>();
+        return;
+    }
+
+    const DecodedInstruction& instruction = m_decoded[address >> 1];
+    m_registers.PC += 2;
+    instruction.handler(*this, instruction);
+}
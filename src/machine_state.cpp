@@ -0,0 +1,187 @@
+#include "machine.hpp"
+#include "machine_ops.hpp"
+#include <cstring>
+
+// Savestate layout, all values little endian:
+//   magic "C8SS", version
+//   PC, SP, I, V0..VF
+//   memory, stack, display rows packed 8 pixels per byte (MSB first)
+//   delay timer, sound timer, waiting for key, waiting for display, quirk profile
+//   instructions per second, cycles, next timer cycle, timer remainder
+//   random seed, random state
+
+namespace
+{
+
+constexpr uint8_t SaveStateMagic[4] = { 'C', '8', 'S', 'S' };
+
+// Where the instructions per second and the clock start
+constexpr uint32_t ClockOffset = sizeof(SaveStateMagic) + 4 + 2 * 3 + 16 +
+    Machine::MemorySize + 2 * Machine::StackSize + 8 * Machine::DisplayHeight + 5;
+static_assert(ClockOffset + 4 + 8 + 8 + 4 + 8 + 8 == Machine::SaveStateSize, "Savestate layout and size differ");
+
+class StateWriter
+{
+public:
+    explicit StateWriter(uint8_t* data) : m_data(data) { }
+
+    void u8(uint8_t value) { *m_data++ = value; }
+    void u16(uint16_t value) { uint(value, 2); }
+    void u32(uint32_t value) { uint(value, 4); }
+    void u64(uint64_t value) { uint(value, 8); }
+
+    void bytes(const void* data, uint32_t size)
+    {
+        std::memcpy(m_data, data, size);
+        m_data += size;
+    }
+
+private:
+    uint8_t* m_data;
+
+    void uint(uint64_t value, uint32_t size)
+    {
+        for (uint32_t index = 0; index < size; index++)
+            *m_data++ = static_cast<uint8_t>(value >> (index * 8));
+    }
+};
+
+class StateReader
+{
+public:
+    explicit StateReader(const uint8_t* data) : m_data(data) { }
+
+    uint8_t u8() { return *m_data++; }
+    uint16_t u16() { return static_cast<uint16_t>(uint(2)); }
+    uint32_t u32() { return static_cast<uint32_t>(uint(4)); }
+    uint64_t u64() { return uint(8); }
+
+    void bytes(void* data, uint32_t size)
+    {
+        std::memcpy(data, m_data, size);
+        m_data += size;
+    }
+
+private:
+    const uint8_t* m_data;
+
+    uint64_t uint(uint32_t size)
+    {
+        uint64_t value = 0;
+        for (uint32_t index = 0; index < size; index++)
+            value |= static_cast<uint64_t>(*m_data++) << (index * 8);
+        return value;
+    }
+};
+
+} // namespace
+
+uint32_t Machine::save_state(uint8_t* data, uint32_t size) const
+{
+    if (size < SaveStateSize)
+        return 0;
+
+    StateWriter writer(data);
+    writer.bytes(SaveStateMagic, sizeof(SaveStateMagic));
+    writer.u32(SaveStateVersion);
+
+    writer.u16(m_registers.PC);
+    writer.u16(m_registers.SP);
+    writer.u16(m_registers.I);
+    writer.bytes(m_registers.V, sizeof(m_registers.V));
+
+    writer.bytes(m_memory, sizeof(m_memory));
+    for (uint32_t index = 0; index < StackSize; index++)
+        writer.u16(m_stack[index]);
+
+    for (uint32_t row = 0; row < DisplayHeight; row++)
+    {
+        for (int shift = 56; shift >= 0; shift -= 8)
+            writer.u8(static_cast<uint8_t>(m_display[row] >> shift));
+    }
+
+    writer.u8(m_delay_timer);
+    writer.u8(m_sound_timer);
+    writer.u8(m_waiting_for_key ? 1 : 0);
+    writer.u8(m_waiting_for_display ? 1 : 0);
+    writer.u8(static_cast<uint8_t>(m_quirk_profile));
+
+    writer.u32(m_instructions_per_second);
+    writer.u64(m_cycles);
+    writer.u64(m_next_timer_cycle);
+    writer.u32(m_timer_remainder);
+
+    writer.u64(m_seed);
+    writer.u64(m_random_state);
+
+    return SaveStateSize;
+}
+
+bool Machine::load_state(const uint8_t* data, uint32_t size)
+{
+    if (size != SaveStateSize || std::memcmp(data, SaveStateMagic, sizeof(SaveStateMagic)) != 0)
+        return false;
+
+    StateReader reader(data + sizeof(SaveStateMagic));
+    if (reader.u32() != SaveStateVersion)
+        return false;
+
+    // Checked before anything changes, run_cycles never returns when the
+    // next timer tick is already behind the clock
+    StateReader clock(data + ClockOffset - 1);
+    const uint8_t profile = clock.u8();
+    clock.u32();
+    const uint64_t cycles = clock.u64();
+    const uint64_t next_timer_cycle = clock.u64();
+    if (profile >= quirks::ProfileCount || next_timer_cycle <= cycles)
+        return false;
+
+    // Before memory, a new profile drops the decoded instructions
+    set_quirk_profile(static_cast<QuirkProfile>(profile));
+
+    // Every access masks PC and SP, wrapped values run the same
+    m_registers.PC = reader.u16() & (MemorySize - 1);
+    m_registers.SP = reader.u16() & (StackSize - 1);
+    m_registers.I = reader.u16();
+    reader.bytes(m_registers.V, sizeof(m_registers.V));
+
+    // Only the changed bytes drop their decoded instruction, a state loaded
+    // back every frame (run-ahead, rewind) keeps the caches warm
+    for (uint32_t address = 0; address < MemorySize; address++)
+    {
+        const uint8_t value = reader.u8();
+        if (value != m_memory[address])
+            write(address, value);
+    }
+
+    for (uint32_t index = 0; index < StackSize; index++)
+        m_stack[index] = reader.u16();
+
+    for (uint32_t row = 0; row < DisplayHeight; row++)
+    {
+        uint64_t pixels = 0;
+        for (uint32_t index = 0; index < 8; index++)
+            pixels = (pixels << 8) | reader.u8();
+        if (pixels != m_display[row])
+        {
+            m_display[row] = pixels;
+            m_dirty_rows |= 1u << row;
+        }
+    }
+
+    m_delay_timer = reader.u8();
+    m_sound_timer = reader.u8();
+    m_waiting_for_key = reader.u8() != 0;
+    m_waiting_for_display = reader.u8() != 0;
+    reader.u8(); // Quirk profile, set above
+
+    set_instructions_per_second(reader.u32());
+    m_cycles = reader.u64();
+    m_next_timer_cycle = reader.u64();
+    m_timer_remainder = reader.u32() % TimerFrequency;
+
+    m_seed = reader.u64();
+    m_random_state = reader.u64();
+
+    return true;
+}
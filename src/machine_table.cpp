@@ -0,0 +1,123 @@
+#include "machine.hpp"
+#include "machine_ops.hpp"
+#include <array>
+#include <utility>
+
+// Handlers for every 16-bit opcode, resolved at compile time. Each handler is
+// specialised on the register operands X and Y it uses, so only the immediate
+// operands are masked out of the opcode at run time. There is one table per
+// quirk profile, kinds no quirk changes share their handlers between them.
+class OpcodeTable
+{
+public:
+    using Handler = void (*)(Machine& machine, uint16_t opcode);
+
+    template <QuirkProfile Profile>
+    static const std::array<Handler, 0x10000> handlers;
+
+private:
+    template <QuirkProfile Profile, Machine::Op Kind, uint8_t X, uint8_t Y>
+    static void execute(Machine& m, uint16_t opcode)
+    {
+        (void)m;
+        (void)opcode;
+
+        if constexpr (Kind == Machine::Op00E0) m.op_00e0();
+        else if constexpr (Kind == Machine::Op00EE) m.op_00ee();
+        else if constexpr (Kind == Machine::Op1nnn) m.op_1nnn(opcode & 0x0FFF);
+        else if constexpr (Kind == Machine::Op2nnn) m.op_2nnn(opcode & 0x0FFF);
+        else if constexpr (Kind == Machine::Op3xkk) m.op_3xkk(X, opcode & 0xFF);
+        else if constexpr (Kind == Machine::Op4xkk) m.op_4xkk(X, opcode & 0xFF);
+        else if constexpr (Kind == Machine::Op5xy0) m.op_5xy0(X, Y);
+        else if constexpr (Kind == Machine::Op6xkk) m.op_6xkk(X, opcode & 0xFF);
+        else if constexpr (Kind == Machine::Op7xkk) m.op_7xkk(X, opcode & 0xFF);
+        else if constexpr (Kind == Machine::Op8xy0) m.op_8xy0(X, Y);
+        else if constexpr (Kind == Machine::Op8xy1) m.op_8xy1<Profile>(X, Y);
+        else if constexpr (Kind == Machine::Op8xy2) m.op_8xy2<Profile>(X, Y);
+        else if constexpr (Kind == Machine::Op8xy3) m.op_8xy3<Profile>(X, Y);
+        else if constexpr (Kind == Machine::Op8xy4) m.op_8xy4(X, Y);
+        else if constexpr (Kind == Machine::Op8xy5) m.op_8xy5(X, Y);
+        else if constexpr (Kind == Machine::Op8xy6) m.op_8xy6<Profile>(X, Y);
+        else if constexpr (Kind == Machine::Op8xy7) m.op_8xy7(X, Y);
+        else if constexpr (Kind == Machine::Op8xyE) m.op_8xye<Profile>(X, Y);
+        else if constexpr (Kind == Machine::Op9xy0) m.op_9xy0(X, Y);
+        else if constexpr (Kind == Machine::OpAnnn) m.op_annn(opcode & 0x0FFF);
+        else if constexpr (Kind == Machine::OpBnnn) m.op_bnnn<Profile>(opcode & 0x0FFF);
+        else if constexpr (Kind == Machine::OpCxkk) m.op_cxkk(X, opcode & 0xFF);
+        else if constexpr (Kind == Machine::OpDxyn) m.op_dxyn<Profile>(X, Y, opcode & 0x0F);
+        else if constexpr (Kind == Machine::OpEx9E) m.op_ex9e(X);
+        else if constexpr (Kind == Machine::OpExA1) m.op_exa1(X);
+        else if constexpr (Kind == Machine::OpFx07) m.op_fx07(X);
+        else if constexpr (Kind == Machine::OpFx0A) m.op_fx0a(X);
+        else if constexpr (Kind == Machine::OpFx15) m.op_fx15(X);
+        else if constexpr (Kind == Machine::OpFx18) m.op_fx18(X);
+        else if constexpr (Kind == Machine::OpFx1E) m.op_fx1e(X);
+        else if constexpr (Kind == Machine::OpFx29) m.op_fx29(X);
+        else if constexpr (Kind == Machine::OpFx33) m.op_fx33(X);
+        else if constexpr (Kind == Machine::OpFx55) m.op_fx55<Profile>(X);
+        else if constexpr (Kind == Machine::OpFx65) m.op_fx65<Profile>(X);
+    }
+
+    static constexpr bool uses_x(Machine::Op kind)
+    {
+        return kind > Machine::Op2nnn && kind != Machine::OpAnnn && kind != Machine::OpBnnn;
+    }
+
+    static constexpr bool uses_y(Machine::Op kind)
+    {
+        return kind == Machine::Op5xy0 || (kind >= Machine::Op8xy0 && kind <= Machine::Op9xy0) || kind == Machine::OpDxyn;
+    }
+
+    static constexpr bool uses_quirks(Machine::Op kind)
+    {
+        return kind == Machine::Op8xy1 || kind == Machine::Op8xy2 || kind == Machine::Op8xy3 ||
+            kind == Machine::Op8xy6 || kind == Machine::Op8xyE || kind == Machine::OpBnnn ||
+            kind == Machine::OpDxyn || kind == Machine::OpFx55 || kind == Machine::OpFx65;
+    }
+
+    // One handler per XY byte of the opcode, operands a kind ignores are fixed
+    // to 0 so that it is only instantiated once for them, the same goes for
+    // the profile of kinds without quirks
+    template <QuirkProfile Profile, Machine::Op Kind, size_t... XY>
+    static constexpr std::array<Handler, 256> kind_handlers(std::index_sequence<XY...>)
+    {
+        constexpr QuirkProfile profile = uses_quirks(Kind) ? Profile : QuirkProfile::Modern;
+        return { { &execute<profile, Kind, uses_x(Kind) ? (XY >> 4) : 0, uses_y(Kind) ? (XY & 0x0F) : 0>... } };
+    }
+
+    template <QuirkProfile Profile, size_t... Kind>
+    static constexpr std::array<Handler, 0x10000> build(std::index_sequence<Kind...>)
+    {
+        constexpr std::array<Handler, 256> kinds[] = {
+            kind_handlers<Profile, static_cast<Machine::Op>(Kind)>(std::make_index_sequence<256>())...
+        };
+
+        std::array<Handler, 0x10000> table {};
+        for (uint32_t opcode = 0; opcode < table.size(); opcode++)
+            table[opcode] = kinds[Machine::decode_op(opcode)][(opcode >> 4) & 0xFF];
+        return table;
+    }
+};
+
+template <QuirkProfile Profile>
+const std::array<OpcodeTable::Handler, 0x10000> OpcodeTable::handlers =
+    OpcodeTable::build<Profile>(std::make_index_sequence<Machine::OpCount>());
+
+template <QuirkProfile Profile>
+inline void Machine::execute_table_instruction()
+{
+    const uint16_t opcode = read_word(m_registers.PC);
+    m_registers.PC += 2;
+    OpcodeTable::handlers<Profile>[opcode](*this, opcode);
+}
+
+template <QuirkProfile Profile>
+void Machine::run_slice_table(uint64_t slice_end)
+{
+    run_slice<Profile, &Machine::execute_table_instruction<Profile>>(slice_end);
+}
+
+template void Machine::run_slice_table<QuirkProfile::Modern>(uint64_t slice_end);
+template void Machine::run_slice_table<QuirkProfile::Vip>(uint64_t slice_end);
+template void Machine::run_slice_table<QuirkProfile::Schip>(uint64_t slice_end);
+template void Machine::run_slice_table<QuirkProfile::XoChip>(uint64_t slice_end);
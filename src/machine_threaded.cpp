@@ -0,0 +1,134 @@
+#include "machine.hpp"
+#include "machine_ops.hpp"
+
+#ifdef CHIP8_COMPUTED_GOTO
+
+// Every handler ends with its own indirect jump to the next one, so the
+// branch predictor learns each instruction pair instead of a single switch.
+template <QuirkProfile Profile>
+void Machine::run_slice_threaded(uint64_t slice_end)
+{
+    static void* const labels[OpCount] = {
+        &&op_decode, &&op_nop,
+        &&op_00e0, &&op_00ee, &&op_1nnn, &&op_2nnn, &&op_3xkk, &&op_4xkk, &&op_5xy0, &&op_6xkk, &&op_7xkk,
+        &&op_8xy0, &&op_8xy1, &&op_8xy2, &&op_8xy3, &&op_8xy4, &&op_8xy5, &&op_8xy6, &&op_8xy7, &&op_8xye,
+        &&op_9xy0, &&op_annn, &&op_bnnn, &&op_cxkk, &&op_dxyn, &&op_ex9e, &&op_exa1,
+        &&op_fx07, &&op_fx0a, &&op_fx15, &&op_fx18, &&op_fx1e, &&op_fx29, &&op_fx33, &&op_fx55, &&op_fx65
+    };
+
+    uint64_t cycles = m_cycles;
+    DecodedInstruction* instruction = nullptr;
+
+#define DISPATCH()                                                  \
+    do                                                              \
+    {                                                               \
+        if (cycles >= slice_end)                                    \
+            goto done;                                              \
+        cycles++;                                                   \
+        if ((m_registers.PC & 1) || m_registers.PC >= MemorySize)   \
+            goto unaligned;                                         \
+        instruction = &m_decoded[m_registers.PC >> 1];              \
+        m_registers.PC += 2;                                        \
+        goto *labels[instruction->op];                              \
+    } while (0)
+
+    DISPATCH();
+
+unaligned:
+    // Odd addresses are not cached
+    execute_next_instruction<Profile>();
+    if (waiting<Profile>())
+        cycles = slice_end;
+    DISPATCH();
+
+op_decode:
+    *instruction = decode<Profile>(read_word(m_registers.PC - 2));
+    goto *labels[instruction->op];
+
+op_nop:    DISPATCH();
+op_00e0:   op_00e0(); DISPATCH();
+op_00ee:   op_00ee(); DISPATCH();
+op_1nnn:   op_1nnn(instruction->nnn); DISPATCH();
+op_2nnn:   op_2nnn(instruction->nnn); DISPATCH();
+op_3xkk:   op_3xkk(instruction->x, instruction->kk); DISPATCH();
+op_4xkk:   op_4xkk(instruction->x, instruction->kk); DISPATCH();
+op_5xy0:   op_5xy0(instruction->x, instruction->y); DISPATCH();
+op_6xkk:   op_6xkk(instruction->x, instruction->kk); DISPATCH();
+op_7xkk:   op_7xkk(instruction->x, instruction->kk); DISPATCH();
+op_8xy0:   op_8xy0(instruction->x, instruction->y); DISPATCH();
+op_8xy1:   op_8xy1<Profile>(instruction->x, instruction->y); DISPATCH();
+op_8xy2:   op_8xy2<Profile>(instruction->x, instruction->y); DISPATCH();
+op_8xy3:   op_8xy3<Profile>(instruction->x, instruction->y); DISPATCH();
+op_8xy4:   op_8xy4(instruction->x, instruction->y); DISPATCH();
+op_8xy5:   op_8xy5(instruction->x, instruction->y); DISPATCH();
+op_8xy6:   op_8xy6<Profile>(instruction->x, instruction->y); DISPATCH();
+op_8xy7:   op_8xy7(instruction->x, instruction->y); DISPATCH();
+op_8xye:   op_8xye<Profile>(instruction->x, instruction->y); DISPATCH();
+op_9xy0:   op_9xy0(instruction->x, instruction->y); DISPATCH();
+op_annn:   op_annn(instruction->nnn); DISPATCH();
+op_bnnn:   op_bnnn<Profile>(instruction->nnn); DISPATCH();
+op_cxkk:   op_cxkk(instruction->x, instruction->kk); DISPATCH();
+
+op_dxyn:
+    op_dxyn<Profile>(instruction->x, instruction->y, instruction->kk & 0x0F);
+    if constexpr (quirks::of(Profile).display_wait)
+        cycles = slice_end;
+    DISPATCH();
+
+op_ex9e:   op_ex9e(instruction->x); DISPATCH();
+op_exa1:   op_exa1(instruction->x); DISPATCH();
+op_fx07:   op_fx07(instruction->x); DISPATCH();
+
+op_fx0a:
+    op_fx0a(instruction->x);
+    if (m_waiting_for_key)
+        cycles = slice_end;
+    DISPATCH();
+
+op_fx15:   op_fx15(instruction->x); DISPATCH();
+op_fx18:   op_fx18(instruction->x); DISPATCH();
+op_fx1e:   op_fx1e(instruction->x); DISPATCH();
+op_fx29:   op_fx29(instruction->x); DISPATCH();
+op_fx33:   op_fx33(instruction->x); DISPATCH();
+op_fx55:   op_fx55<Profile>(instruction->x); DISPATCH();
+op_fx65:   op_fx65<Profile>(instruction->x); DISPATCH();
+
+#undef DISPATCH
+
+done:
+    m_cycles = cycles;
+}
+
+#else
+
+// Portable fallback, dispatch through the handler table indexed by instruction kind
+template <QuirkProfile Profile>
+void Machine::run_slice_threaded(uint64_t slice_end)
+{
+    while (m_cycles < slice_end)
+    {
+        const uint16_t address = m_registers.PC;
+        if ((address & 1) || address >= MemorySize)
+        {
+            execute_next_instruction<Profile>();
+        }
+        else
+        {
+            const DecodedInstruction& instruction = m_decoded[address >> 1];
+            m_registers.PC += 2;
+            m_handlers<Profile>[instruction.op](*this, instruction);
+        }
+
+        m_cycles++;
+
+        if (waiting<Profile>())
+            m_cycles = slice_end;
+    }
+}
+
+#endif // CHIP8_COMPUTED_GOTO
+
+template void Machine::run_slice_threaded<QuirkProfile::Modern>(uint64_t slice_end);
+template void Machine::run_slice_threaded<QuirkProfile::Vip>(uint64_t slice_end);
+template void Machine::run_slice_threaded<QuirkProfile::Schip>(uint64_t slice_end);
+template void Machine::run_slice_threaded<QuirkProfile::XoChip>(uint64_t slice_end);
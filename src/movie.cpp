@@ -0,0 +1,130 @@
+#include "movie.hpp"
+#include "utils.hpp"
+#include <cstring>
+
+// Movie file, all values little endian:
+//   magic "C8MV", version, ROM hash, seed, instructions per second, quirk profile
+//   frame count, key event count
+//   key events (u32 frame, u16 keys)
+//   state hash after each frame
+
+static constexpr uint8_t MovieMagic[4] = { 'C', '8', 'M', 'V' };
+static constexpr uint32_t HeaderSize = 4 + 4 + 8 + 8 + 4 + 4 + 4 + 4;
+static constexpr uint32_t EventSize = 4 + 2;
+
+static void put(std::vector<uint8_t>& data, uint64_t value, uint32_t size)
+{
+    for (uint32_t index = 0; index < size; index++)
+        data.push_back(static_cast<uint8_t>(value >> (index * 8)));
+}
+
+static uint64_t get(const uint8_t*& data, uint32_t size)
+{
+    uint64_t value = 0;
+    for (uint32_t index = 0; index < size; index++)
+        value |= static_cast<uint64_t>(*data++) << (index * 8);
+    return value;
+}
+
+void Movie::start(const Machine& machine, const uint8_t* rom, uint32_t rom_size)
+{
+    rom_hash = hash_rom(rom, rom_size);
+    seed = machine.seed();
+    instructions_per_second = machine.instructions_per_second();
+    quirk_profile = machine.quirk_profile();
+    events.clear();
+    hashes.clear();
+}
+
+void Movie::record_frame(uint16_t keys, const Machine& machine)
+{
+    const uint16_t previous = events.empty() ? 0 : events.back().keys;
+    if (keys != previous)
+        events.push_back({ frame_count(), keys });
+
+    hashes.push_back(machine.hash());
+}
+
+bool Movie::save(const std::string& file_path) const
+{
+    std::vector<uint8_t> data(MovieMagic, MovieMagic + sizeof(MovieMagic));
+    data.reserve(HeaderSize + events.size() * EventSize + hashes.size() * sizeof(uint64_t));
+
+    put(data, Version, 4);
+    put(data, rom_hash, 8);
+    put(data, seed, 8);
+    put(data, instructions_per_second, 4);
+    put(data, static_cast<uint32_t>(quirk_profile), 4);
+    put(data, hashes.size(), 4);
+    put(data, events.size(), 4);
+
+    for (const auto& event : events)
+    {
+        put(data, event.frame, 4);
+        put(data, event.keys, 2);
+    }
+
+    for (uint64_t hash : hashes)
+        put(data, hash, 8);
+
+    return utils::write_file(file_path, data.data(), data.size());
+}
+
+bool Movie::load(const std::string& file_path)
+{
+    std::vector<uint8_t> data;
+    if (!utils::read_file(file_path, data))
+        return false;
+
+    if (data.size() < HeaderSize || std::memcmp(data.data(), MovieMagic, sizeof(MovieMagic)) != 0)
+        return false;
+
+    const uint8_t* input = data.data() + sizeof(MovieMagic);
+    if (get(input, 4) != Version)
+        return false;
+
+    rom_hash = get(input, 8);
+    seed = get(input, 8);
+    instructions_per_second = (uint32_t)get(input, 4);
+    const uint64_t profile = get(input, 4);
+    const uint64_t frame_count = get(input, 4);
+    const uint64_t event_count = get(input, 4);
+
+    if (profile >= quirks::ProfileCount ||
+        data.size() != HeaderSize + event_count * EventSize + frame_count * sizeof(uint64_t))
+        return false;
+
+    quirk_profile = static_cast<QuirkProfile>(profile);
+
+    events.resize(event_count);
+    for (auto& event : events)
+    {
+        event.frame = (uint32_t)get(input, 4);
+        event.keys = (uint16_t)get(input, 2);
+    }
+
+    hashes.resize(frame_count);
+    for (auto& hash : hashes)
+        hash = get(input, 8);
+
+    return true;
+}
+
+uint64_t Movie::hash_rom(const uint8_t* rom, uint32_t rom_size)
+{
+    // FNV-1a
+    uint64_t value = 0xCBF29CE484222325ull;
+    for (uint32_t index = 0; index < rom_size; index++)
+    {
+        value ^= rom[index];
+        value *= 0x100000001B3ull;
+    }
+
+    return value;
+}
+
+void MovieInput::set_frame(uint32_t frame)
+{
+    while (m_next_event < m_movie.events.size() && m_movie.events[m_next_event].frame <= frame)
+        m_keys = m_movie.events[m_next_event++].keys;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "backend.hpp"
+#include "machine.hpp"
+
+// Input recording of a run from reset: the key changes by frame and the state
+// hash after every frame. The keys can only change between frames, so a movie
+// replays exactly on any engine and the hashes tell at which frame a replay
+// went wrong.
+class Movie
+{
+public:
+    static inline constexpr uint32_t Version = 3;
+
+    struct KeyEvent
+    {
+        uint32_t frame;
+        uint16_t keys; // Bit n set while key n is held
+    };
+
+    uint64_t rom_hash = 0;
+    uint64_t seed = 0;
+    uint32_t instructions_per_second = Machine::DefaultInstructionsPerSecond;
+    QuirkProfile quirk_profile = QuirkProfile::Modern;
+    std::vector<KeyEvent> events;
+    std::vector<uint64_t> hashes;
+
+    uint32_t frame_count() const { return (uint32_t)hashes.size(); }
+
+    // Starts a recording of a machine just reset with the ROM loaded
+    void start(const Machine& machine, const uint8_t* rom, uint32_t rom_size);
+
+    // Adds a frame run with keys held
+    void record_frame(uint16_t keys, const Machine& machine);
+
+    bool save(const std::string& file_path) const;
+    bool load(const std::string& file_path);
+
+    static uint64_t hash_rom(const uint8_t* rom, uint32_t rom_size);
+};
+
+// Feeds the keys of a movie to a machine, set the frame before running it
+class MovieInput final : public InputBackend
+{
+public:
+    explicit MovieInput(const Movie& movie) : m_movie(movie) { }
+
+    void set_frame(uint32_t frame);
+    uint16_t keys() const { return m_keys; }
+
+    bool is_key_pressed(uint8_t key) override { return (m_keys >> key) & 1; }
+
+private:
+    const Movie& m_movie;
+    size_t m_next_event = 0;
+    uint16_t m_keys = 0;
+};
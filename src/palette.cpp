@@ -0,0 +1,130 @@
+#include "palette.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace palette
+{
+
+const Palette Presets[PresetCount] = {
+    { "Yellow", { 0xFF000000, 0xFFFFFF00, 0xFFFF8000, 0xFF808000 } },
+    { "White", { 0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555 } },
+    { "Green", { 0xFF0A1A0A, 0xFF33FF66, 0xFF1F9940, 0xFF0F4D20 } },
+    { "Amber", { 0xFF1A0F00, 0xFFFFB000, 0xFFB37A00, 0xFF664600 } },
+    { "Handheld", { 0xFF9BBC0F, 0xFF0F380F, 0xFF306230, 0xFF8BAC0F } },
+};
+
+} // namespace palette
+
+namespace
+{
+
+// Each byte of a row is broadcast to all lanes, a lane compares its own bit to
+// get an all ones mask for set pixels and the masks select between colors
+#if defined(__AVX2__)
+
+constexpr const char* KernelName = "avx2";
+constexpr uint32_t Lanes = 8;
+using Vector = __m256i;
+
+inline Vector splat(uint32_t value) { return _mm256_set1_epi32(static_cast<int>(value)); }
+inline Vector vector_and(Vector a, Vector b) { return _mm256_and_si256(a, b); }
+inline Vector vector_xor(Vector a, Vector b) { return _mm256_xor_si256(a, b); }
+inline Vector is_set(Vector pixels, Vector bit) { return _mm256_cmpeq_epi32(_mm256_and_si256(pixels, bit), bit); }
+inline void store(uint32_t* output, Vector value) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(output), value); }
+inline Vector pixel_bits(uint32_t group) { (void)group; return _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01); }
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+constexpr const char* KernelName = "sse2";
+constexpr uint32_t Lanes = 4;
+using Vector = __m128i;
+
+inline Vector splat(uint32_t value) { return _mm_set1_epi32(static_cast<int>(value)); }
+inline Vector vector_and(Vector a, Vector b) { return _mm_and_si128(a, b); }
+inline Vector vector_xor(Vector a, Vector b) { return _mm_xor_si128(a, b); }
+inline Vector is_set(Vector pixels, Vector bit) { return _mm_cmpeq_epi32(_mm_and_si128(pixels, bit), bit); }
+inline void store(uint32_t* output, Vector value) { _mm_storeu_si128(reinterpret_cast<__m128i*>(output), value); }
+inline Vector pixel_bits(uint32_t group) { return group == 0 ? _mm_setr_epi32(0x80, 0x40, 0x20, 0x10) : _mm_setr_epi32(0x08, 0x04, 0x02, 0x01); }
+
+#else
+
+constexpr const char* KernelName = "scalar";
+
+#endif
+
+template <bool TwoPlanes>
+void expand_planes(const uint64_t* plane0, const uint64_t* plane1, uint32_t words, const Palette& palette, uint32_t* output)
+{
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    constexpr uint32_t Groups = 8 / Lanes;
+    Vector bits[Groups];
+    for (uint32_t group = 0; group < Groups; group++)
+        bits[group] = pixel_bits(group);
+
+    const Vector color0 = splat(palette.colors[0]);
+    const Vector select1 = splat(palette.colors[0] ^ palette.colors[1]);
+    const Vector color2 = splat(palette.colors[2]);
+    const Vector select3 = splat(palette.colors[2] ^ palette.colors[3]);
+
+    for (uint32_t word = 0; word < words; word++)
+    {
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            const Vector pixels0 = splat(static_cast<uint32_t>(plane0[word] >> shift) & 0xFF);
+            const Vector pixels1 = TwoPlanes ? splat(static_cast<uint32_t>(plane1[word] >> shift) & 0xFF) : splat(0);
+
+            for (uint32_t group = 0; group < Groups; group++)
+            {
+                const Vector mask0 = is_set(pixels0, bits[group]);
+                Vector color = vector_xor(color0, vector_and(mask0, select1));
+                if constexpr (TwoPlanes)
+                {
+                    const Vector high = vector_xor(color2, vector_and(mask0, select3));
+                    const Vector mask1 = is_set(pixels1, bits[group]);
+                    color = vector_xor(color, vector_and(mask1, vector_xor(color, high)));
+                }
+
+                store(output, color);
+                output += Lanes;
+            }
+        }
+    }
+#else
+    for (uint32_t word = 0; word < words; word++)
+    {
+        for (int bit = 63; bit >= 0; bit--)
+        {
+            uint32_t index = static_cast<uint32_t>(plane0[word] >> bit) & 1;
+            if constexpr (TwoPlanes)
+                index |= (static_cast<uint32_t>(plane1[word] >> bit) & 1) << 1;
+            *output++ = palette.colors[index];
+        }
+    }
+#endif
+}
+
+} // namespace
+
+namespace palette
+{
+
+const char* kernel_name()
+{
+    return KernelName;
+}
+
+void expand(const uint64_t* plane, uint32_t words, const Palette& palette, uint32_t* output)
+{
+    expand_planes<false>(plane, nullptr, words, palette, output);
+}
+
+void expand(const uint64_t* plane0, const uint64_t* plane1, uint32_t words, const Palette& palette, uint32_t* output)
+{
+    expand_planes<true>(plane0, plane1, words, palette, output);
+}
+
+} // namespace palette
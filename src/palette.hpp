@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+// Display colors as ARGB8888. With two bit planes a pixel takes the color at
+// (plane 1 bit << 1) | plane 0 bit, a single plane only uses the first two.
+struct Palette
+{
+    static inline constexpr uint32_t ColorCount = 4;
+
+    const char* name;
+    uint32_t colors[ColorCount];
+};
+
+// Kernels turning rows of 1 bit pixels, leftmost pixel in the most significant
+// bit of each 64-bit word, into colors
+namespace palette
+{
+
+static inline constexpr uint32_t PresetCount = 5;
+extern const Palette Presets[PresetCount];
+
+// Vector instructions the kernels were built with: "avx2", "sse2" or "scalar"
+const char* kernel_name();
+
+// Writes words * 64 colors to output
+void expand(const uint64_t* plane, uint32_t words, const Palette& palette, uint32_t* output);
+void expand(const uint64_t* plane0, const uint64_t* plane1, uint32_t words, const Palette& palette, uint32_t* output);
+
+} // namespace palette
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <string>
 
 struct SDL_Window;
@@ -9,4 +10,10 @@ namespace platform
 
 std::string open_file_dialog(SDL_Window* owner);
 
+// Sleeps until an absolute time, late wake ups don't add up over many sleeps
+void sleep_until(std::chrono::steady_clock::time_point deadline);
+
+// Runs the calling thread on one core only, any core when core is negative
+bool pin_current_thread(int core);
+
 } // namespace platform
@@ -1,7 +1,12 @@
 #include "platform.hpp"
 
 #ifdef __linux__
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
+#include <time.h>
+#include <thread>
 
 namespace platform
 {
@@ -30,5 +35,36 @@ std::string open_file_dialog(SDL_Window* owner)
     return std::string(selected_file);
 }
 
+void sleep_until(std::chrono::steady_clock::time_point deadline)
+{
+    // steady_clock reads CLOCK_MONOTONIC
+    const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    timespec time {};
+    time.tv_sec = nanoseconds / 1000000000;
+    time.tv_nsec = nanoseconds % 1000000000;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, nullptr) == EINTR)
+        ;
+}
+
+bool pin_current_thread(int core)
+{
+    const int core_count = (int)std::thread::hardware_concurrency();
+    if (core >= core_count || core >= CPU_SETSIZE)
+        return false;
+
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+    if (core >= 0)
+        CPU_SET(core, &cores);
+    else
+    {
+        for (int index = 0; index < core_count && index < CPU_SETSIZE; index++)
+            CPU_SET(index, &cores);
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores) == 0;
+}
+
 } // namespace platform
 #endif // Linux
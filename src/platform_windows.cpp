@@ -4,6 +4,7 @@
 #include <Windows.h>
 #include <commdlg.h>
 #include <SDL_syswm.h>
+#include <thread>
 
 namespace platform
 {
@@ -47,5 +48,28 @@ std::string open_file_dialog(SDL_Window* owner)
     return {};
 }
 
+void sleep_until(std::chrono::steady_clock::time_point deadline)
+{
+    std::this_thread::sleep_until(deadline);
+}
+
+bool pin_current_thread(int core)
+{
+    DWORD_PTR process_mask = 0;
+    DWORD_PTR system_mask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+        return false;
+
+    DWORD_PTR mask = process_mask;
+    if (core >= 0)
+    {
+        if (core >= (int)(sizeof(DWORD_PTR) * 8))
+            return false;
+        mask = (DWORD_PTR)1 << core;
+    }
+
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
 } // namespace platform
 #endif // Windows
@@ -0,0 +1,47 @@
+#include "quirks.hpp"
+#include <cstring>
+
+namespace quirks
+{
+
+const char* name(QuirkProfile profile)
+{
+    switch (profile)
+    {
+    case QuirkProfile::Modern: return "modern";
+    case QuirkProfile::Vip:    return "vip";
+    case QuirkProfile::Schip:  return "schip";
+    case QuirkProfile::XoChip: return "xochip";
+    }
+
+    return "";
+}
+
+const char* label(QuirkProfile profile)
+{
+    switch (profile)
+    {
+    case QuirkProfile::Modern: return "Modern";
+    case QuirkProfile::Vip:    return "COSMAC VIP";
+    case QuirkProfile::Schip:  return "SUPER-CHIP";
+    case QuirkProfile::XoChip: return "XO-CHIP";
+    }
+
+    return "";
+}
+
+bool from_name(const char* name, QuirkProfile& profile)
+{
+    for (QuirkProfile candidate : Profiles)
+    {
+        if (std::strcmp(name, quirks::name(candidate)) == 0)
+        {
+            profile = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace quirks
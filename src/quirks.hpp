@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+// Behaviours CHIP-8 interpreters disagree on, all of them off is the modern
+// behaviour most programs written today expect
+struct Quirks
+{
+    bool shift_vy = false;       // 8xy6 and 8xyE shift Vy into Vx, otherwise Vx in place
+    bool load_store_i = false;   // Fx55 and Fx65 leave I after the last register
+    bool logic_reset_vf = false; // 8xy1, 8xy2 and 8xy3 clear VF
+    bool jump_vx = false;        // Bxnn jumps to xnn + Vx, otherwise Bnnn to nnn + V0
+    bool sprite_wrap = false;    // Sprite pixels past an edge are drawn on the opposite side, otherwise clipped
+    bool display_wait = false;   // Dxyn waits for the next timer tick, the vertical blank
+};
+
+// The engines are compiled once per profile, its quirks are constants there
+enum class QuirkProfile : uint8_t
+{
+    Modern,
+    Vip,    // COSMAC VIP
+    Schip,  // SUPER-CHIP 1.1
+    XoChip  // XO-CHIP
+};
+
+namespace quirks
+{
+
+static inline constexpr uint32_t ProfileCount = 4;
+static inline constexpr QuirkProfile Profiles[ProfileCount] = {
+    QuirkProfile::Modern, QuirkProfile::Vip, QuirkProfile::Schip, QuirkProfile::XoChip
+};
+
+constexpr Quirks of(QuirkProfile profile)
+{
+    Quirks result;
+    switch (profile)
+    {
+    case QuirkProfile::Modern:
+        break;
+
+    case QuirkProfile::Vip:
+        result.shift_vy = true;
+        result.load_store_i = true;
+        result.logic_reset_vf = true;
+        result.display_wait = true;
+        break;
+
+    case QuirkProfile::Schip:
+        result.jump_vx = true;
+        break;
+
+    case QuirkProfile::XoChip:
+        result.shift_vy = true;
+        result.load_store_i = true;
+        result.sprite_wrap = true;
+        break;
+    }
+
+    return result;
+}
+
+// Command line name ("modern", "vip", "schip", "xochip") and menu label
+const char* name(QuirkProfile profile);
+const char* label(QuirkProfile profile);
+bool from_name(const char* name, QuirkProfile& profile);
+
+// Calls function with the profile as a std::integral_constant, so that the
+// template for that profile can be picked once outside the hot loop
+template <typename Function>
+void dispatch(QuirkProfile profile, Function&& function)
+{
+    switch (profile)
+    {
+    case QuirkProfile::Modern: function(std::integral_constant<QuirkProfile, QuirkProfile::Modern>()); break;
+    case QuirkProfile::Vip:    function(std::integral_constant<QuirkProfile, QuirkProfile::Vip>()); break;
+    case QuirkProfile::Schip:  function(std::integral_constant<QuirkProfile, QuirkProfile::Schip>()); break;
+    case QuirkProfile::XoChip: function(std::integral_constant<QuirkProfile, QuirkProfile::XoChip>()); break;
+    }
+}
+
+} // namespace quirks
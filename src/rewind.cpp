@@ -0,0 +1,147 @@
+#include "rewind.hpp"
+#include <cstring>
+
+// Delta records: u16 bytes skipped, u16 byte count, then the XOR of those bytes
+// with the keyframe. A record ends after MinZeroRun equal bytes.
+static constexpr uint32_t MinZeroRun = 4;
+
+RewindBuffer::RewindBuffer(uint32_t budget)
+    : m_budget(budget)
+{
+}
+
+void RewindBuffer::set_budget(uint32_t budget)
+{
+    m_budget = budget;
+    trim();
+}
+
+uint32_t RewindBuffer::frame_count() const
+{
+    uint32_t count = 0;
+    for (const auto& group : m_groups)
+        count += 1 + (uint32_t)group.offsets.size();
+    return count;
+}
+
+void RewindBuffer::clear()
+{
+    m_groups.clear();
+    m_size = 0;
+}
+
+void RewindBuffer::push(const Machine& machine)
+{
+    machine.save_state(m_state, sizeof(m_state));
+
+    if (m_groups.empty() || m_groups.back().offsets.size() + 1 >= KeyframeInterval)
+    {
+        m_groups.emplace_back();
+        std::memcpy(m_groups.back().keyframe, m_state, sizeof(m_state));
+        m_size += group_size(m_groups.back());
+    }
+    else
+    {
+        Group& group = m_groups.back();
+        const uint32_t start = (uint32_t)group.deltas.size();
+        group.offsets.push_back(start);
+        encode(group.keyframe, group.deltas);
+        m_size += (uint32_t)(group.deltas.size() - start) + sizeof(uint32_t);
+    }
+
+    trim();
+}
+
+bool RewindBuffer::rewind(Machine& machine)
+{
+    if (m_groups.empty())
+        return false;
+
+    Group& group = m_groups.back();
+    if (group.offsets.empty())
+    {
+        machine.load_state(group.keyframe, sizeof(group.keyframe));
+        m_size -= group_size(group);
+        m_groups.pop_back();
+        return true;
+    }
+
+    const uint32_t start = group.offsets.back();
+    decode(group.keyframe, group.deltas.data() + start, group.deltas.data() + group.deltas.size());
+    machine.load_state(m_state, sizeof(m_state));
+
+    m_size -= (uint32_t)(group.deltas.size() - start) + sizeof(uint32_t);
+    group.deltas.resize(start);
+    group.offsets.pop_back();
+    return true;
+}
+
+uint32_t RewindBuffer::group_size(const Group& group)
+{
+    return sizeof(group.keyframe) + (uint32_t)group.deltas.size() + (uint32_t)group.offsets.size() * sizeof(uint32_t);
+}
+
+// The newest group is always kept so that the latest frames can be rewound
+void RewindBuffer::trim()
+{
+    while (m_size > m_budget && m_groups.size() > 1)
+    {
+        m_size -= group_size(m_groups.front());
+        m_groups.pop_front();
+    }
+}
+
+void RewindBuffer::encode(const uint8_t* keyframe, std::vector<uint8_t>& output) const
+{
+    auto put_u16 = [&output](uint32_t value)
+    {
+        output.push_back(static_cast<uint8_t>(value));
+        output.push_back(static_cast<uint8_t>(value >> 8));
+    };
+
+    uint32_t index = 0;
+    while (index < sizeof(m_state))
+    {
+        // Skip equal bytes a word at a time
+        const uint32_t skip_start = index;
+        while (index + 8 <= sizeof(m_state) && std::memcmp(m_state + index, keyframe + index, 8) == 0)
+            index += 8;
+        while (index < sizeof(m_state) && m_state[index] == keyframe[index])
+            index++;
+
+        if (index == sizeof(m_state))
+            break;
+
+        // Changed bytes up to the next run of equal ones
+        uint32_t end = index;
+        uint32_t zero_run = 0;
+        while (end < sizeof(m_state) && zero_run < MinZeroRun)
+        {
+            zero_run = (m_state[end] == keyframe[end]) ? zero_run + 1 : 0;
+            end++;
+        }
+        end -= zero_run;
+
+        put_u16(index - skip_start);
+        put_u16(end - index);
+        for (; index < end; index++)
+            output.push_back(m_state[index] ^ keyframe[index]);
+    }
+}
+
+void RewindBuffer::decode(const uint8_t* keyframe, const uint8_t* input, const uint8_t* end)
+{
+    std::memcpy(m_state, keyframe, sizeof(m_state));
+
+    uint32_t index = 0;
+    while (input < end)
+    {
+        const uint32_t skip = input[0] | (input[1] << 8);
+        const uint32_t count = input[2] | (input[3] << 8);
+        input += 4;
+
+        index += skip;
+        for (uint32_t byte = 0; byte < count; byte++)
+            m_state[index++] ^= *input++;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "machine.hpp"
+
+// History of machine states for rewinding, one snapshot per frame.
+//
+// Snapshots are grouped behind a full keyframe state, every other snapshot of
+// the group is stored as the run length encoded XOR of its state against the
+// keyframe. Frames change few bytes so a delta is usually some tens of bytes.
+// The oldest groups are dropped when the history goes over its memory budget.
+class RewindBuffer
+{
+public:
+    static inline constexpr uint32_t DefaultBudget = 8 * 1024 * 1024;
+    static inline constexpr uint32_t KeyframeInterval = 60;
+
+    explicit RewindBuffer(uint32_t budget = DefaultBudget);
+
+    void set_budget(uint32_t budget);
+    uint32_t budget() const { return m_budget; }
+
+    // Bytes held by the stored snapshots
+    uint32_t size() const { return m_size; }
+    uint32_t frame_count() const;
+
+    void clear();
+
+    // Stores the machine state as the latest snapshot
+    void push(const Machine& machine);
+
+    // Loads the latest snapshot into the machine and removes it, false when empty
+    bool rewind(Machine& machine);
+
+private:
+    struct Group
+    {
+        uint8_t keyframe[Machine::SaveStateSize];
+        std::vector<uint8_t> deltas;
+        std::vector<uint32_t> offsets; // Start of each delta in deltas
+    };
+
+    std::deque<Group> m_groups;
+    uint32_t m_budget = DefaultBudget;
+    uint32_t m_size = 0;
+    uint8_t m_state[Machine::SaveStateSize];
+
+    static uint32_t group_size(const Group& group);
+    void trim();
+    void encode(const uint8_t* keyframe, std::vector<uint8_t>& output) const;
+    void decode(const uint8_t* keyframe, const uint8_t* input, const uint8_t* end);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+// Bounded queue between one producer thread and one consumer thread without
+// locks. Each side caches the other side's index and only reloads it when the
+// queue looks full or empty.
+template <typename T, uint32_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Producer side, false when the queue is full
+    bool push(T value)
+    {
+        const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head_cache == Capacity)
+        {
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            if (tail - m_head_cache == Capacity)
+                return false;
+        }
+
+        m_items[tail & (Capacity - 1)] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, false when the queue is empty
+    bool pop(T& value)
+    {
+        const uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail_cache)
+        {
+            m_tail_cache = m_tail.load(std::memory_order_acquire);
+            if (head == m_tail_cache)
+                return false;
+        }
+
+        value = std::move(m_items[head & (Capacity - 1)]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T m_items[Capacity] {};
+
+    alignas(64) std::atomic<uint32_t> m_head { 0 };
+    uint32_t m_tail_cache = 0; // Consumer copy of m_tail
+
+    alignas(64) std::atomic<uint32_t> m_tail { 0 };
+    uint32_t m_head_cache = 0; // Producer copy of m_head
+};
@@ -0,0 +1,442 @@
+#include "machine.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs every ROM x seed x input script combination headless on a work
+// stealing thread pool and prints the final state hash of each instance.
+
+// Keys held from a frame on, read from lines of "frame keys" where keys is the
+// hexadecimal mask of the held CHIP-8 keys (bit n for key n)
+struct InputScript
+{
+    struct Event
+    {
+        uint32_t frame;
+        uint16_t keys;
+    };
+
+    std::string name;
+    std::vector<Event> events;
+};
+
+static bool read_script(const std::string& file_path, InputScript& script)
+{
+    std::ifstream file(file_path);
+    if (!file.is_open())
+        return false;
+
+    script.name = file_path;
+    script.events.clear();
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        unsigned long frame = 0;
+        unsigned long keys = 0;
+        if (std::sscanf(line.c_str(), "%lu %lx", &frame, &keys) != 2)
+            return false;
+
+        script.events.push_back({ (uint32_t)frame, (uint16_t)keys });
+    }
+
+    std::stable_sort(script.events.begin(), script.events.end(),
+        [](const InputScript::Event& a, const InputScript::Event& b) { return a.frame < b.frame; });
+    return true;
+}
+
+class ScriptInput final : public InputBackend
+{
+public:
+    void start(const InputScript* script)
+    {
+        m_script = script;
+        m_next_event = 0;
+        m_keys = 0;
+    }
+
+    // Applies the events of the frame about to run
+    void set_frame(uint32_t frame)
+    {
+        if (!m_script)
+            return;
+
+        while (m_next_event < m_script->events.size() && m_script->events[m_next_event].frame <= frame)
+            m_keys = m_script->events[m_next_event++].keys;
+    }
+
+    bool is_key_pressed(uint8_t key) override { return (m_keys >> key) & 1; }
+
+private:
+    const InputScript* m_script = nullptr;
+    size_t m_next_event = 0;
+    uint16_t m_keys = 0;
+};
+
+struct Job
+{
+    uint32_t rom;
+    uint32_t script;
+    uint64_t seed;
+};
+
+struct JobResult
+{
+    uint64_t hash = 0;
+    uint64_t cycles = 0;
+    uint8_t display[Machine::DisplayWidth * Machine::DisplayHeight / 8] = { };
+};
+
+// Jobs of one worker, the owner takes from the back and thieves from the front
+class JobQueue
+{
+public:
+    void push(uint32_t job)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(job);
+    }
+
+    bool pop(uint32_t& job)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_jobs.empty())
+            return false;
+
+        job = m_jobs.back();
+        m_jobs.pop_back();
+        return true;
+    }
+
+    bool steal(uint32_t& job)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_jobs.empty())
+            return false;
+
+        job = m_jobs.front();
+        m_jobs.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::deque<uint32_t> m_jobs;
+};
+
+// Everything a thread touches while running, the machine is reused for each of its jobs
+struct alignas(64) Worker
+{
+    JobQueue queue;
+    Machine machine;
+    ScriptInput input;
+    uint32_t jobs_stolen = 0;
+};
+
+struct Options
+{
+    uint32_t frames = 600;
+    uint32_t seeds = 1;
+    uint64_t first_seed = 0;
+    uint32_t threads = 0;
+    uint32_t instructions_per_second = Machine::DefaultInstructionsPerSecond;
+    Machine::Engine engine = Machine::Engine::Cached;
+    QuirkProfile quirk_profile = QuirkProfile::Modern;
+    std::vector<std::string> roms;
+    std::vector<std::string> scripts;
+    std::string dump_directory;
+};
+
+class BatchRunner
+{
+public:
+    BatchRunner(const Options& options,
+        const std::vector<std::vector<uint8_t>>& roms,
+        const std::vector<InputScript>& scripts)
+        : m_options(options)
+        , m_roms(roms)
+        , m_scripts(scripts)
+    {
+        for (uint32_t rom = 0; rom < roms.size(); rom++)
+        {
+            for (uint32_t seed = 0; seed < options.seeds; seed++)
+            {
+                for (uint32_t script = 0; script < scripts.size(); script++)
+                    m_jobs.push_back({ rom, script, options.first_seed + seed });
+            }
+        }
+
+        m_results.resize(m_jobs.size());
+    }
+
+    const std::vector<Job>& jobs() const { return m_jobs; }
+    const std::vector<JobResult>& results() const { return m_results; }
+
+    void run(uint32_t thread_count)
+    {
+        m_workers.clear();
+        for (uint32_t index = 0; index < thread_count; index++)
+        {
+            m_workers.push_back(std::make_unique<Worker>());
+            m_workers.back()->machine.set_engine(m_options.engine);
+            m_workers.back()->machine.set_instructions_per_second(m_options.instructions_per_second);
+            m_workers.back()->machine.set_quirk_profile(m_options.quirk_profile);
+            m_workers.back()->machine.set_idle_skip(true);
+            m_workers.back()->machine.set_input(&m_workers.back()->input);
+        }
+
+        // Jobs of a ROM are dealt in contiguous runs so that a worker keeps its caches warm
+        for (uint32_t job = 0; job < m_jobs.size(); job++)
+            m_workers[(uint64_t)job * thread_count / m_jobs.size()]->queue.push(job);
+
+        std::vector<std::thread> threads;
+        for (uint32_t index = 0; index < thread_count; index++)
+            threads.emplace_back(&BatchRunner::work, this, index);
+
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    uint32_t jobs_stolen() const
+    {
+        uint32_t stolen = 0;
+        for (const auto& worker : m_workers)
+            stolen += worker->jobs_stolen;
+        return stolen;
+    }
+
+private:
+    const Options& m_options;
+    const std::vector<std::vector<uint8_t>>& m_roms;
+    const std::vector<InputScript>& m_scripts;
+    std::vector<Job> m_jobs;
+    std::vector<JobResult> m_results;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    void work(uint32_t index)
+    {
+        Worker& worker = *m_workers[index];
+        uint32_t job = 0;
+
+        for (;;)
+        {
+            if (!worker.queue.pop(job))
+            {
+                // Jobs are all queued before the threads start, when no queue
+                // has one left the batch is done
+                bool stolen = false;
+                for (uint32_t offset = 1; offset < m_workers.size() && !stolen; offset++)
+                    stolen = m_workers[(index + offset) % m_workers.size()]->queue.steal(job);
+
+                if (!stolen)
+                    return;
+
+                worker.jobs_stolen++;
+            }
+
+            run_job(worker, m_jobs[job], m_results[job]);
+        }
+    }
+
+    void run_job(Worker& worker, const Job& job, JobResult& result)
+    {
+        const std::vector<uint8_t>& rom = m_roms[job.rom];
+        Machine& machine = worker.machine;
+
+        machine.clear_memory();
+        machine.set_seed(job.seed);
+        machine.load_rom(rom.data(), (uint32_t)rom.size());
+        worker.input.start(&m_scripts[job.script]);
+
+        for (uint32_t frame = 0; frame < m_options.frames; frame++)
+        {
+            worker.input.set_frame(frame);
+            machine.run_frame();
+        }
+
+        result.hash = machine.hash();
+        result.cycles = machine.cycles();
+
+        // PBM rows are MSB first bytes, the same order as the display rows
+        const uint64_t* display = machine.display();
+        for (uint32_t row = 0; row < Machine::DisplayHeight; row++)
+        {
+            for (uint32_t index = 0; index < 8; index++)
+                result.display[row * 8 + index] = static_cast<uint8_t>(display[row] >> (56 - index * 8));
+        }
+    }
+};
+
+// Writes the display as a binary PBM image
+static bool write_display(const std::string& file_path, const JobResult& result)
+{
+    std::ofstream file(file_path, std::ofstream::binary);
+    if (!file.is_open())
+        return false;
+
+    file << "P4\n" << Machine::DisplayWidth << " " << Machine::DisplayHeight << "\n";
+    file.write(reinterpret_cast<const char*>(result.display), sizeof(result.display));
+    return static_cast<bool>(file);
+}
+
+static void print_usage()
+{
+    std::fprintf(stderr,
+        "Usage: chip8_batch [options] rom_file...\n"
+        "  --frames N      timer frames run by each instance (600)\n"
+        "  --seeds N       random seeds run per ROM and input script (1)\n"
+        "  --seed N        first random seed (0)\n"
+        "  --threads N     worker threads (one per core)\n"
+        "  --ips N         instructions per second (%u)\n"
+        "  --engine NAME   switch, cached, threaded, table or jit (cached)\n"
+        "  --quirks NAME   modern, vip, schip or xochip (modern)\n"
+        "  --script FILE   input script, each one adds a run of every ROM\n"
+        "  --dump DIR      write the final display of every instance as PBM\n",
+        Machine::DefaultInstructionsPerSecond);
+}
+
+static bool parse_options(int argc, char *argv[], Options& options)
+{
+    for (int index = 1; index < argc; index++)
+    {
+        const char* arg = argv[index];
+        const char* value = (index + 1 < argc) ? argv[index + 1] : nullptr;
+
+        if (arg[0] != '-')
+        {
+            options.roms.push_back(arg);
+            continue;
+        }
+
+        if (!value)
+            return false;
+
+        if (std::strcmp(arg, "--frames") == 0)
+            options.frames = (uint32_t)std::strtoul(value, nullptr, 10);
+        else if (std::strcmp(arg, "--seeds") == 0)
+            options.seeds = (uint32_t)std::strtoul(value, nullptr, 10);
+        else if (std::strcmp(arg, "--seed") == 0)
+            options.first_seed = std::strtoull(value, nullptr, 0);
+        else if (std::strcmp(arg, "--threads") == 0)
+            options.threads = (uint32_t)std::strtoul(value, nullptr, 10);
+        else if (std::strcmp(arg, "--ips") == 0)
+            options.instructions_per_second = (uint32_t)std::strtoul(value, nullptr, 10);
+        else if (std::strcmp(arg, "--engine") == 0)
+        {
+            if (!Machine::engine_from_name(value, options.engine))
+                return false;
+        }
+        else if (std::strcmp(arg, "--quirks") == 0)
+        {
+            if (!quirks::from_name(value, options.quirk_profile))
+                return false;
+        }
+        else if (std::strcmp(arg, "--script") == 0)
+            options.scripts.push_back(value);
+        else if (std::strcmp(arg, "--dump") == 0)
+            options.dump_directory = value;
+        else
+            return false;
+
+        index++;
+    }
+
+    return !options.roms.empty() && options.seeds > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        print_usage();
+        return -1;
+    }
+
+    std::vector<std::vector<uint8_t>> roms(options.roms.size());
+    for (size_t index = 0; index < roms.size(); index++)
+    {
+        if (!utils::read_file(options.roms[index], roms[index]))
+        {
+            std::fprintf(stderr, "Cannot read ROM from file %s\n", options.roms[index].c_str());
+            return -1;
+        }
+
+        if ((Machine::MemorySize - Machine::ResetVector) < roms[index].size())
+        {
+            std::fprintf(stderr, "Invalid ROM size %s\n", options.roms[index].c_str());
+            return -1;
+        }
+    }
+
+    // Without scripts every ROM runs once with no key pressed
+    std::vector<InputScript> scripts(std::max<size_t>(options.scripts.size(), 1));
+    for (size_t index = 0; index < options.scripts.size(); index++)
+    {
+        if (!read_script(options.scripts[index], scripts[index]))
+        {
+            std::fprintf(stderr, "Cannot read input script %s\n", options.scripts[index].c_str());
+            return -1;
+        }
+    }
+
+    if (options.scripts.empty())
+        scripts[0].name = "-";
+
+    uint32_t thread_count = options.threads ? options.threads : std::thread::hardware_concurrency();
+    thread_count = std::max(thread_count, 1u);
+
+    BatchRunner runner(options, roms, scripts);
+    thread_count = std::min<uint32_t>(thread_count, (uint32_t)runner.jobs().size());
+
+    auto start = std::chrono::steady_clock::now();
+    runner.run(thread_count);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t total_cycles = 0;
+    int status = 0;
+    for (size_t index = 0; index < runner.jobs().size(); index++)
+    {
+        const Job& job = runner.jobs()[index];
+        const JobResult& result = runner.results()[index];
+        total_cycles += result.cycles;
+
+        std::printf("%s %llu %s %016llX\n",
+            options.roms[job.rom].c_str(),
+            (unsigned long long)job.seed,
+            scripts[job.script].name.c_str(),
+            (unsigned long long)result.hash);
+
+        if (!options.dump_directory.empty())
+        {
+            const std::string file_path = options.dump_directory + "/" + std::to_string(index) + ".pbm";
+            if (!write_display(file_path, result))
+            {
+                std::fprintf(stderr, "Cannot write %s\n", file_path.c_str());
+                status = 1;
+            }
+        }
+    }
+
+    std::fprintf(stderr, "%zu instances, %u threads, %u stolen, %.3f s, %.2f MIPS\n",
+        runner.jobs().size(),
+        thread_count,
+        runner.jobs_stolen(),
+        elapsed,
+        total_cycles / elapsed / 1000000.0);
+
+    return status;
+}
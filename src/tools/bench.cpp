@@ -0,0 +1,627 @@
+#include "beeper.hpp"
+#include "bench_rom.hpp"
+#include "lockstep.hpp"
+#include "machine.hpp"
+#include "palette.hpp"
+#include "rewind.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+// Defined by the C++ file chip8_recompile emits for the built-in workload
+void bench_static_run(Machine& machine, uint64_t slice_end);
+
+struct EngineResult
+{
+    const char* name;
+    double elapsed;
+    uint64_t hash;
+};
+
+static EngineResult run_engine(const char* name, Machine::Engine engine, const std::vector<uint8_t>& rom, uint64_t instructions, uint32_t instructions_per_second,
+    QuirkProfile profile = QuirkProfile::Modern)
+{
+    // Best of a few runs to filter out noise from other processes
+    constexpr int RUN_COUNT = 3;
+
+    EngineResult result { name, 0.0, 0 };
+    for (int run = 0; run < RUN_COUNT; run++)
+    {
+        Machine machine;
+        machine.set_engine(engine);
+        machine.set_quirk_profile(profile);
+        machine.set_instructions_per_second(instructions_per_second);
+        machine.load_rom(rom.data(), (uint32_t)rom.size());
+
+        auto start = std::chrono::steady_clock::now();
+        machine.run_cycles(instructions);
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (run == 0 || elapsed < result.elapsed)
+            result.elapsed = elapsed;
+        result.hash = machine.hash();
+    }
+
+    return result;
+}
+
+// The lanes together run as many instructions as a single engine, every lane
+// has to end in the same state as a lone machine run for the same cycles.
+// The batch runs them in chunks that end between timer ticks. The first run
+// is not timed, its short chunks often end while a lane waits for the
+// display and the lanes are checked against the lone machine after each one.
+static EngineResult run_lockstep(const std::vector<uint8_t>& rom, uint64_t instructions, uint32_t instructions_per_second, bool& lanes_match,
+    QuirkProfile profile = QuirkProfile::Modern)
+{
+    constexpr int RUN_COUNT = 4;
+    const uint64_t cycles = instructions / LockstepBatch::MaxLanes;
+
+    Machine reference;
+    reference.set_quirk_profile(profile);
+    reference.set_instructions_per_second(instructions_per_second);
+    reference.load_rom(rom.data(), (uint32_t)rom.size());
+
+    EngineResult result { "lockstep", 0.0, 0 };
+    lanes_match = true;
+    for (int run = 0; run < RUN_COUNT; run++)
+    {
+        LockstepBatch batch(LockstepBatch::MaxLanes);
+        batch.set_quirk_profile(profile);
+        batch.set_instructions_per_second(instructions_per_second);
+        batch.load_rom(rom.data(), (uint32_t)rom.size());
+
+        if (run == 0)
+        {
+            constexpr uint64_t CHUNK_CYCLES = 7;
+            for (uint64_t done = 0; done < cycles; done += CHUNK_CYCLES)
+            {
+                const uint64_t chunk = std::min(CHUNK_CYCLES, cycles - done);
+                reference.run_cycles(chunk);
+                batch.run_cycles(chunk);
+
+                for (uint32_t index = 0; index < batch.lane_count(); index++)
+                {
+                    const Machine& lane = batch.lane(index);
+                    if (lane.cycles() != reference.cycles() ||
+                        std::memcmp(&lane.registers(), &reference.registers(), sizeof(Machine::Registers)) != 0)
+                        lanes_match = false;
+                }
+            }
+
+            result.hash = reference.hash();
+        }
+        else
+        {
+            constexpr uint64_t CHUNK_CYCLES = 1000;
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t done = 0; done < cycles; done += CHUNK_CYCLES)
+                batch.run_cycles(std::min(CHUNK_CYCLES, cycles - done));
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (run == 1 || elapsed < result.elapsed)
+                result.elapsed = elapsed;
+        }
+
+        for (uint32_t index = 0; index < batch.lane_count(); index++)
+        {
+            if (batch.lane(index).hash() != result.hash)
+                lanes_match = false;
+        }
+    }
+
+    return result;
+}
+
+// Every engine and the lockstep batch run each quirk profile, all of them
+// have to end in the same state for the profile
+static bool run_quirks(const std::vector<uint8_t>& rom, uint64_t instructions, uint32_t instructions_per_second)
+{
+    bool all_match = true;
+    for (QuirkProfile profile : quirks::Profiles)
+    {
+        const EngineResult results[] = {
+            run_engine("switch", Machine::Engine::Switch, rom, instructions, instructions_per_second, profile),
+            run_engine("cached", Machine::Engine::Cached, rom, instructions, instructions_per_second, profile),
+            run_engine("threaded", Machine::Engine::Threaded, rom, instructions, instructions_per_second, profile),
+            run_engine("table", Machine::Engine::Table, rom, instructions, instructions_per_second, profile),
+            run_engine("jit", Machine::Engine::Jit, rom, instructions, instructions_per_second, profile),
+        };
+
+        bool matches = true;
+        for (const auto& result : results)
+            matches = matches && result.hash == results[0].hash;
+
+        bool lanes_match = false;
+        run_lockstep(rom, instructions, instructions_per_second, lanes_match, profile);
+        matches = matches && lanes_match;
+
+        std::printf("%-8s %8.2f MIPS  cached, all engines  state %016llX%s\n",
+            quirks::name(profile),
+            instructions / results[1].elapsed / 1000000.0,
+            (unsigned long long)results[0].hash,
+            matches ? "" : "  MISMATCH");
+
+        all_match = all_match && matches;
+    }
+
+    return all_match;
+}
+
+// The built-in workload translated by chip8_recompile at build time runs
+// next to the cached engine. The first run is not timed, the states are
+// compared after every frame so a divergence names the frame it starts in.
+// The timed run compares them at every checkpoint.
+static bool run_static(uint64_t instructions, uint32_t instructions_per_second)
+{
+    constexpr int CHECKPOINT_COUNT = 100;
+    constexpr uint32_t FRAME_COUNT = 600;
+
+    Machine frames[2];
+    Machine machines[2];
+    for (Machine* pair : { frames, machines })
+    {
+        pair[0].set_engine(Machine::Engine::Cached);
+        pair[1].set_engine(Machine::Engine::Static);
+        pair[1].set_static_runner(&bench_static_run);
+
+        for (int index = 0; index < 2; index++)
+        {
+            pair[index].set_instructions_per_second(instructions_per_second);
+            pair[index].load_rom(bench_rom, sizeof(bench_rom));
+        }
+    }
+
+    for (uint32_t frame = 0; frame < FRAME_COUNT; frame++)
+    {
+        frames[0].run_frame();
+        frames[1].run_frame();
+
+        if (frames[0].hash() != frames[1].hash())
+        {
+            std::printf("%-8s diverges from cached at frame %u  MISMATCH\n", "static", frame);
+            return false;
+        }
+    }
+
+    double elapsed[2] = { 0.0, 0.0 };
+
+    bool matches = true;
+    for (int checkpoint = 0; checkpoint < CHECKPOINT_COUNT && matches; checkpoint++)
+    {
+        for (int index = 0; index < 2; index++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            machines[index].run_cycles(instructions / CHECKPOINT_COUNT);
+            elapsed[index] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        matches = machines[0].hash() == machines[1].hash();
+    }
+
+    std::printf("%-8s %8.2f MIPS  x%.2f over cached  built-in ROM%s\n",
+        "static",
+        instructions / elapsed[1] / 1000000.0,
+        elapsed[0] / elapsed[1],
+        matches ? "" : "  MISMATCH");
+
+    return matches;
+}
+
+// Blocks only run when they fit before the next timer tick, at the default
+// rate most of them end up interpreted. Uncapped rates give the JIT long
+// slices, it has to end in the same state as the threaded engine.
+static bool run_high_rate(const std::vector<uint8_t>& rom, uint64_t instructions)
+{
+    constexpr uint32_t HIGH_INSTRUCTIONS_PER_SECOND = 600000;
+
+    const EngineResult threaded = run_engine("threaded", Machine::Engine::Threaded, rom, instructions, HIGH_INSTRUCTIONS_PER_SECOND);
+    const EngineResult jit = run_engine("jit", Machine::Engine::Jit, rom, instructions, HIGH_INSTRUCTIONS_PER_SECOND);
+
+    const bool matches = threaded.hash == jit.hash;
+    std::printf("%-8s %8.2f MIPS  x%.2f over threaded  %u IPS%s\n",
+        "jit-fast",
+        instructions / jit.elapsed / 1000000.0,
+        threaded.elapsed / jit.elapsed,
+        HIGH_INSTRUCTIONS_PER_SECOND,
+        matches ? "" : "  MISMATCH");
+
+    return matches;
+}
+
+// Same run with and without idle loop skipping, both have to end in the same
+// state. The ROM sets the delay timer and waits for it to run out, at a high
+// rate nearly every instruction is spent in the wait loop.
+static bool run_idle_skip(uint64_t instructions)
+{
+    constexpr uint32_t HIGH_INSTRUCTIONS_PER_SECOND = 600000;
+    static constexpr uint8_t WAIT_ROM[] = {
+        0x60, 0x1E,     // 200: V0 = 30
+        0xF0, 0x15,     // 202: DT = V0
+        0xF1, 0x07,     // 204: V1 = DT
+        0x31, 0x00,     // 206: skip if V1 == 0
+        0x12, 0x04,     // 208: jump 204
+        0x72, 0x01,     // 20A: V2 += 1
+        0x12, 0x00,     // 20C: jump 200
+    };
+
+    double elapsed[2] = { 0.0, 0.0 };
+    uint64_t hashes[2] = { 0, 0 };
+
+    for (int index = 0; index < 2; index++)
+    {
+        Machine machine;
+        machine.set_engine(Machine::Engine::Cached);
+        machine.set_idle_skip(index == 1);
+        machine.set_instructions_per_second(HIGH_INSTRUCTIONS_PER_SECOND);
+        machine.load_rom(WAIT_ROM, sizeof(WAIT_ROM));
+
+        auto start = std::chrono::steady_clock::now();
+        machine.run_cycles(instructions);
+        elapsed[index] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        hashes[index] = machine.hash();
+    }
+
+    const bool matches = hashes[0] == hashes[1];
+    std::printf("%-8s %8.2f MIPS  x%.2f without skipping  wait loop ROM  %u IPS%s\n",
+        "idle",
+        instructions / elapsed[1] / 1000000.0,
+        elapsed[0] / elapsed[1],
+        HIGH_INSTRUCTIONS_PER_SECOND,
+        matches ? "" : "  MISMATCH");
+
+    return matches;
+}
+
+// Times save and load of a state taken halfway, the loaded machine has to
+// reach the same state as the one that kept running
+static bool run_savestate(const std::vector<uint8_t>& rom, uint64_t instructions, uint32_t instructions_per_second)
+{
+    constexpr int RUN_COUNT = 1000;
+
+    Machine machine;
+    machine.set_engine(Machine::Engine::Cached);
+    machine.set_instructions_per_second(instructions_per_second);
+    machine.load_rom(rom.data(), (uint32_t)rom.size());
+    machine.run_cycles(instructions / 2);
+
+    uint8_t state[Machine::SaveStateSize];
+    auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < RUN_COUNT; run++)
+        machine.save_state(state, sizeof(state));
+    auto save_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Machine loaded;
+    loaded.set_engine(Machine::Engine::Cached);
+    start = std::chrono::steady_clock::now();
+    for (int run = 0; run < RUN_COUNT; run++)
+        loaded.load_state(state, sizeof(state));
+    auto load_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool matches = loaded.hash() == machine.hash();
+    machine.run_cycles(instructions / 2);
+    loaded.run_cycles(instructions / 2);
+    matches = matches && loaded.hash() == machine.hash();
+
+    std::printf("%-8s %8.2f us save  %.2f us load  %u bytes%s\n",
+        "state",
+        save_elapsed / RUN_COUNT * 1000000.0,
+        load_elapsed / RUN_COUNT * 1000000.0,
+        Machine::SaveStateSize,
+        matches ? "" : "  MISMATCH");
+
+    return matches;
+}
+
+// Times the capture of one rewind snapshot per frame, then rewinds every
+// frame and checks it against the hash recorded when it was captured
+static bool run_rewind(const std::vector<uint8_t>& rom, uint32_t instructions_per_second)
+{
+    constexpr uint32_t FRAME_COUNT = 3600;
+
+    Machine machine;
+    machine.set_engine(Machine::Engine::Cached);
+    machine.set_instructions_per_second(instructions_per_second);
+    machine.load_rom(rom.data(), (uint32_t)rom.size());
+
+    RewindBuffer rewind;
+    std::vector<uint64_t> hashes;
+    double capture_elapsed = 0.0;
+    for (uint32_t frame = 0; frame < FRAME_COUNT; frame++)
+    {
+        machine.run_frame();
+        hashes.push_back(machine.hash());
+
+        auto start = std::chrono::steady_clock::now();
+        rewind.push(machine);
+        capture_elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const uint32_t stored = rewind.frame_count();
+    const uint32_t size = rewind.size();
+
+    bool matches = stored > 0;
+    for (uint32_t frame = 0; frame < stored; frame++)
+    {
+        rewind.rewind(machine);
+        if (machine.hash() != hashes[FRAME_COUNT - 1 - frame])
+            matches = false;
+    }
+
+    std::printf("%-8s %8.2f us capture  %u frames  %u bytes/frame%s\n",
+        "rewind",
+        capture_elapsed / FRAME_COUNT * 1000000.0,
+        stored,
+        stored ? size / stored : 0,
+        matches ? "" : "  MISMATCH");
+
+    return matches;
+}
+
+// Expands 64x32, 128x64 and two plane 128x64 frames with the palette kernel and
+// with a loop looking up every pixel, both have to give the same colors. One
+// word changes every frame so neither loop can be hoisted.
+static bool run_palette()
+{
+    constexpr uint32_t FRAME_COUNT = 20000;
+
+    static const struct { const char* name; uint32_t width; uint32_t height; uint32_t planes; } cases[] = {
+        { "64x32", 64, 32, 1 },
+        { "128x64", 128, 64, 1 },
+        { "128x64x2", 128, 64, 2 },
+    };
+
+    const Palette& colors = palette::Presets[0];
+    uint64_t random = 0x9E3779B97F4A7C15ull;
+    bool all_match = true;
+
+    for (const auto& test : cases)
+    {
+        const uint32_t words = test.width * test.height / 64;
+        std::vector<uint64_t> initial(words * 2);
+        for (uint64_t& word : initial)
+        {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            word = random;
+        }
+
+        std::vector<uint32_t> expanded(words * 64);
+        std::vector<uint32_t> reference(words * 64);
+
+        std::vector<uint64_t> planes = initial;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t frame = 0; frame < FRAME_COUNT; frame++)
+        {
+            planes[frame % words] ^= frame;
+            if (test.planes == 1)
+                palette::expand(planes.data(), words, colors, expanded.data());
+            else
+                palette::expand(planes.data(), planes.data() + words, words, colors, expanded.data());
+        }
+        const double kernel_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        planes = initial;
+        start = std::chrono::steady_clock::now();
+        for (uint32_t frame = 0; frame < FRAME_COUNT; frame++)
+        {
+            planes[frame % words] ^= frame;
+            for (uint32_t pixel = 0; pixel < words * 64; pixel++)
+            {
+                const uint32_t bit = 63 - pixel % 64;
+                uint32_t index = (planes[pixel / 64] >> bit) & 1;
+                if (test.planes == 2)
+                    index |= ((planes[words + pixel / 64] >> bit) & 1) << 1;
+                reference[pixel] = colors.colors[index];
+            }
+        }
+        const double reference_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const bool matches = expanded == reference;
+        std::printf("%-8s %8.2f us/frame  x%.2f over per pixel  %s %s%s\n",
+            "palette",
+            kernel_elapsed / FRAME_COUNT * 1000000.0,
+            reference_elapsed / kernel_elapsed,
+            test.name,
+            palette::kernel_name(),
+            matches ? "" : "  MISMATCH");
+
+        if (!matches)
+            all_match = false;
+    }
+
+    return all_match;
+}
+
+// Renders a minute of sound in 512 sample callbacks, the sound switching every
+// six timer ticks, against computing every sample with sin() like the audio
+// callback used to. Every change has to arrive in time.
+static bool run_beeper()
+{
+    constexpr uint32_t TICK_COUNT = 60 * Machine::TimerFrequency;
+    constexpr uint32_t BUFFER_SAMPLES = 512;
+    constexpr uint32_t INSTRUCTIONS_PER_SECOND = Machine::DefaultInstructionsPerSecond;
+    constexpr uint32_t CYCLES_PER_TICK = INSTRUCTIONS_PER_SECOND / Machine::TimerFrequency;
+
+    Beeper beeper;
+    beeper.set_latency(2 * BUFFER_SAMPLES);
+    const uint32_t samples_per_tick = beeper.sample_rate() / Machine::TimerFrequency;
+
+    std::vector<int16_t> buffer(BUFFER_SAMPLES);
+    uint32_t rendered = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t tick = 0; tick < TICK_COUNT; tick++)
+    {
+        beeper.set_sound((tick / 6) % 2 != 0, (uint64_t)tick * CYCLES_PER_TICK, INSTRUCTIONS_PER_SECOND);
+        for (; rendered + BUFFER_SAMPLES <= (tick + 1) * samples_per_tick; rendered += BUFFER_SAMPLES)
+            beeper.render(buffer.data(), BUFFER_SAMPLES, 1);
+    }
+    const double beeper_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const double period = (double)beeper.sample_rate() / Beeper::ToneFrequency;
+    const double angular_frequency = (1.0 / period) * 2.0 * std::acos(-1.0);
+    int position = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t sample = 0; sample < rendered; sample++)
+    {
+        position++;
+        if (position % (int)period == 0)
+            position = 0;
+        buffer[sample % BUFFER_SAMPLES] = (int16_t)(std::sin(position * angular_frequency) * 32767.0);
+    }
+    const double reference_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const bool in_time = beeper.late_events() == 0 && beeper.resyncs() == 0;
+    std::printf("%-8s %8.2f ns/sample  x%.2f over sin()  %u late  %u resyncs%s\n",
+        "beeper",
+        beeper_elapsed / rendered * 1000000000.0,
+        reference_elapsed / beeper_elapsed,
+        beeper.late_events(),
+        beeper.resyncs(),
+        in_time ? "" : "  LATE");
+
+    return in_time;
+}
+
+// Cost of a frame with run-ahead against a plain frame: save, run the frames
+// ahead, load back. The machine has to follow the same timeline as one run
+// without run-ahead.
+static bool run_run_ahead(const std::vector<uint8_t>& rom, uint32_t instructions_per_second, Machine::Engine engine)
+{
+    constexpr uint32_t FRAME_COUNT = 600;
+    constexpr uint32_t AHEAD_FRAMES = 2;
+
+    Machine plain;
+    Machine machine;
+    for (Machine* target : { &plain, &machine })
+    {
+        target->set_engine(engine);
+        target->set_instructions_per_second(instructions_per_second);
+        target->load_rom(rom.data(), (uint32_t)rom.size());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < FRAME_COUNT; frame++)
+        plain.run_frame();
+    auto plain_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint8_t state[Machine::SaveStateSize];
+    start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < FRAME_COUNT; frame++)
+    {
+        machine.run_frame();
+        machine.save_state(state, sizeof(state));
+        for (uint32_t ahead = 0; ahead < AHEAD_FRAMES; ahead++)
+            machine.run_frame();
+        machine.load_state(state, sizeof(state));
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const bool matches = machine.hash() == plain.hash();
+    std::printf("%-8s %8.2f us/frame  plain %.2f us  %u frames ahead%s\n",
+        "runahead",
+        elapsed / FRAME_COUNT * 1000000.0,
+        plain_elapsed / FRAME_COUNT * 1000000.0,
+        AHEAD_FRAMES,
+        matches ? "" : "  MISMATCH");
+
+    return matches;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<uint8_t> rom(bench_rom, bench_rom + sizeof(bench_rom));
+    uint64_t instructions = 50000000;
+    uint32_t instructions_per_second = Machine::DefaultInstructionsPerSecond;
+
+    // "-" keeps the built-in workload
+    if (argc > 1 && std::strcmp(argv[1], "-") != 0 && !utils::read_file(argv[1], rom))
+    {
+        std::fprintf(stderr, "Cannot read ROM from file %s\n", argv[1]);
+        return -1;
+    }
+
+    if (argc > 2)
+        instructions = std::strtoull(argv[2], nullptr, 10);
+
+    if (argc > 3)
+        instructions_per_second = (uint32_t)std::strtoul(argv[3], nullptr, 10);
+
+    if ((Machine::MemorySize - Machine::ResetVector) < rom.size())
+    {
+        std::fprintf(stderr, "Invalid ROM size\n");
+        return -1;
+    }
+
+    const EngineResult results[] = {
+        run_engine("switch", Machine::Engine::Switch, rom, instructions, instructions_per_second),
+        run_engine("cached", Machine::Engine::Cached, rom, instructions, instructions_per_second),
+        run_engine("threaded", Machine::Engine::Threaded, rom, instructions, instructions_per_second),
+        run_engine("table", Machine::Engine::Table, rom, instructions, instructions_per_second),
+        run_engine("jit", Machine::Engine::Jit, rom, instructions, instructions_per_second),
+    };
+
+    int status = 0;
+    for (const auto& result : results)
+    {
+        bool matches = result.hash == results[0].hash;
+        std::printf("%-8s %8.2f MIPS  x%.2f  state %016llX%s\n",
+            result.name,
+            instructions / result.elapsed / 1000000.0,
+            results[0].elapsed / result.elapsed,
+            (unsigned long long)result.hash,
+            matches ? "" : "  MISMATCH");
+
+        if (!matches)
+            status = 1;
+    }
+
+    bool lanes_match = false;
+    const EngineResult lockstep = run_lockstep(rom, instructions, instructions_per_second, lanes_match);
+    std::printf("%-8s %8.2f MIPS  x%.2f  %u lanes%s\n",
+        lockstep.name,
+        instructions / lockstep.elapsed / 1000000.0,
+        results[0].elapsed / lockstep.elapsed,
+        LockstepBatch::MaxLanes,
+        lanes_match ? "" : "  MISMATCH");
+
+    if (!lanes_match)
+        status = 1;
+
+    if (!run_quirks(rom, instructions / 10, instructions_per_second))
+        status = 1;
+
+    if (!run_static(instructions, instructions_per_second))
+        status = 1;
+
+    if (!run_high_rate(rom, instructions))
+        status = 1;
+
+    if (!run_idle_skip(instructions))
+        status = 1;
+
+    if (!run_savestate(rom, instructions, instructions_per_second))
+        status = 1;
+
+    if (!run_rewind(rom, instructions_per_second))
+        status = 1;
+
+    if (!run_run_ahead(rom, instructions_per_second, Machine::Engine::Cached))
+        status = 1;
+
+    if (!run_run_ahead(rom, instructions_per_second, Machine::Engine::Jit))
+        status = 1;
+
+    if (!run_palette())
+        status = 1;
+
+    if (!run_beeper())
+        status = 1;
+
+    return status;
+}
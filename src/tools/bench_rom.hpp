@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+// Synthetic workload of chip8_bench and chip8_recompile when no ROM is given:
+// ALU ops, skips, a call with a sprite draw, BCD and register stores in a
+// tight loop.
+static inline constexpr uint8_t bench_rom[] = {
+    0x6A, 0x3F, // 200: VA = 0x3F
+    0x6B, 0x0F, // 202: VB = 0x0F
+    0x70, 0x01, // 204: V0 += 1
+    0x71, 0x03, // 206: V1 += 3
+    0x82, 0x00, // 208: V2 = V0
+    0x82, 0xA2, // 20A: V2 &= VA
+    0x83, 0x10, // 20C: V3 = V1
+    0x83, 0xB2, // 20E: V3 &= VB
+    0x84, 0x14, // 210: V4 += V1
+    0x84, 0x06, // 212: V4 >>= 1
+    0x85, 0x45, // 214: V5 -= V4
+    0x86, 0x57, // 216: V6 = V5 - V6
+    0x86, 0x0E, // 218: V6 = V0 << 1
+    0x95, 0x60, // 21A: skip if V5 != V6
+    0x00, 0x00, // 21C: nop
+    0x36, 0x00, // 21E: skip if V6 == 0
+    0x22, 0x30, // 220: call 0x230
+    0xA2, 0x40, // 222: I = 0x240
+    0xF4, 0x33, // 224: BCD V4
+    0xF1, 0x55, // 226: store V0..V1
+    0xF7, 0x1E, // 228: I += V7
+    0x12, 0x04, // 22A: jump 0x204
+    0x00, 0x00, // 22C
+    0x00, 0x00, // 22E
+    0xA2, 0x38, // 230: I = 0x238
+    0xD2, 0x35, // 232: draw V2, V3, 5 rows
+    0x00, 0xEE, // 234: return
+    0x00, 0x00, // 236
+    0xF0, 0x90, 0x90, 0x90, 0xF0, 0x00, 0x00, 0x00 // 238: sprite
+};
@@ -0,0 +1,127 @@
+#include "machine.hpp"
+#include "palette.hpp"
+#include <SDL.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Times getting the display into a streaming texture and on screen, once by
+// expanding into a color buffer copied with SDL_UpdateTexture and once by
+// expanding straight into the locked texture, on the software and the
+// accelerated renderer. The texture is scaled to a hidden window like the
+// emulator does and the renderers run without vsync.
+
+static constexpr int Width = Machine::DisplayWidth;
+static constexpr int Height = Machine::DisplayHeight;
+
+struct Display
+{
+    uint64_t rows[Height] = { };
+    uint64_t random = 0x9E3779B97F4A7C15ull;
+
+    // Every frame changes all rows, like a game clearing and redrawing the screen
+    void next_frame()
+    {
+        for (uint64_t& row : rows)
+        {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            row = random;
+        }
+    }
+};
+
+static void update_path(SDL_Texture* texture, const Display& display, const Palette& colors, uint32_t* buffer)
+{
+    palette::expand(display.rows, Height, colors, buffer);
+    SDL_UpdateTexture(texture, nullptr, buffer, Width * sizeof(uint32_t));
+}
+
+static void lock_path(SDL_Texture* texture, const Display& display, const Palette& colors)
+{
+    void* pixels = nullptr;
+    int pitch = 0;
+    if (SDL_LockTexture(texture, nullptr, &pixels, &pitch) != 0)
+        return;
+
+    for (int row = 0; row < Height; row++)
+        palette::expand(&display.rows[row], 1, colors, reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(pixels) + row * pitch));
+
+    SDL_UnlockTexture(texture);
+}
+
+static bool run_renderer(const char* name, Uint32 flags, uint32_t frames)
+{
+    SDL_Window* window = SDL_CreateWindow("chip8_present", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, Width * 10, Height * 10, SDL_WINDOW_HIDDEN);
+    SDL_Renderer* renderer = window ? SDL_CreateRenderer(window, -1, flags) : nullptr;
+    SDL_Texture* texture = renderer ? SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, Width, Height) : nullptr;
+    if (!texture)
+    {
+        std::printf("%-12s unavailable: %s\n", name, SDL_GetError());
+        if (renderer)
+            SDL_DestroyRenderer(renderer);
+        if (window)
+            SDL_DestroyWindow(window);
+        return false;
+    }
+
+    SDL_RendererInfo info {};
+    SDL_GetRendererInfo(renderer, &info);
+
+    const Palette& colors = palette::Presets[0];
+    std::vector<uint32_t> buffer(Width * Height);
+    double elapsed[2] = { 0.0, 0.0 };
+
+    for (int path = 0; path < 2; path++)
+    {
+        Display display;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t frame = 0; frame < frames; frame++)
+        {
+            display.next_frame();
+            if (path == 0)
+                update_path(texture, display, colors, buffer.data());
+            else
+                lock_path(texture, display, colors);
+
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+            SDL_RenderPresent(renderer);
+        }
+        elapsed[path] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::printf("%-12s %-10s update %8.2f us/frame  lock %8.2f us/frame  x%.2f\n",
+        name,
+        info.name,
+        elapsed[0] / frames * 1000000.0,
+        elapsed[1] / frames * 1000000.0,
+        elapsed[0] / elapsed[1]);
+
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t frames = 10000;
+    if (argc > 1)
+        frames = (uint32_t)std::strtoul(argv[1], nullptr, 10);
+
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    {
+        std::fprintf(stderr, "SDL_Init error: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    std::printf("%u frames, %s palette kernel\n", frames, palette::kernel_name());
+    run_renderer("software", SDL_RENDERER_SOFTWARE, frames);
+    run_renderer("accelerated", SDL_RENDERER_ACCELERATED, frames);
+
+    SDL_Quit();
+    return 0;
+}
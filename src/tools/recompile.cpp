@@ -0,0 +1,366 @@
+#include "bench_rom.hpp"
+#include "machine.hpp"
+#include "utils.hpp"
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Ahead of time translation of a ROM to a C++ slice runner for Engine::Static.
+//
+// Every even ROM address becomes a case of a switch on PC. Straight line code
+// falls through from one case to the next and jumps, calls and skips with a
+// known target use goto. Bnnn, returns and any address without a case go back
+// through the switch, and an address whose word no longer matches the ROM
+// (self modifying code) is run by the cached interpreter instead. The runner
+// is translated for one quirk profile and the machine has to use the same.
+
+// Enumerator of the profile in the generated code
+static const char* profile_enumerator(QuirkProfile profile)
+{
+    switch (profile)
+    {
+    case QuirkProfile::Modern: return "QuirkProfile::Modern";
+    case QuirkProfile::Vip:    return "QuirkProfile::Vip";
+    case QuirkProfile::Schip:  return "QuirkProfile::Schip";
+    case QuirkProfile::XoChip: return "QuirkProfile::XoChip";
+    }
+
+    return "";
+}
+
+static std::string label(uint16_t address)
+{
+    char text[8];
+    std::snprintf(text, sizeof(text), "L%03X", address);
+    return text;
+}
+
+class Translator
+{
+public:
+    Translator(const std::vector<uint8_t>& rom, QuirkProfile profile)
+        : m_rom(rom)
+        , m_profile(profile)
+        , m_end(Machine::ResetVector + (uint32_t)rom.size())
+        , m_targets(Machine::MemorySize, false)
+    {
+        // Only addresses reached by goto get a label
+        for (uint32_t address = Machine::ResetVector; address + 1 < m_end; address += 2)
+        {
+            const uint16_t value = word(address);
+            switch (value >> 12)
+            {
+            case 0x1:
+            case 0x2:
+                m_targets[value & 0x0FFF] = true;
+                break;
+
+            case 0x3:
+            case 0x4:
+            case 0x5:
+            case 0x9:
+            case 0xE:
+                m_targets[(address + 4) & (Machine::MemorySize - 1)] = true;
+                break;
+            }
+        }
+    }
+
+    std::string translate(const std::string& name)
+    {
+        line("// Generated by chip8_recompile, do not edit");
+        line("#include \"machine_ops.hpp\"");
+        line("");
+        line("namespace");
+        line("{");
+        line("struct Program;");
+        line("}");
+        line("");
+        line("template <>");
+        line("class StaticProgram<Program>");
+        line("{");
+        line("public:");
+        line(std::string("    static constexpr QuirkProfile Profile = ") + profile_enumerator(m_profile) + ";");
+        line("");
+        line("    static void run(Machine& m, uint64_t slice_end)");
+        line("    {");
+        line("        Machine::Registers& r = m.m_registers;");
+        line("        for (;;)");
+        line("        {");
+        line("            switch (r.PC)");
+        line("            {");
+
+        for (uint32_t address = Machine::ResetVector; address + 1 < m_end; address += 2)
+            translate_instruction((uint16_t)address);
+
+        line("            default:");
+        line("            interpret:");
+        line("                if (m.m_cycles >= slice_end)");
+        line("                    return;");
+        line("                m.execute_cached_instruction<Profile>();");
+        line("                m.m_cycles++;");
+        line("                if (m.waiting<Profile>())");
+        line("                {");
+        line("                    m.m_cycles = slice_end;");
+        line("                    return;");
+        line("                }");
+        line("                break;");
+        line("            }");
+        line("        }");
+        line("    }");
+        line("};");
+        line("");
+
+        line("extern const uint8_t " + name + "_rom[] = {");
+        for (size_t index = 0; index < m_rom.size(); index += 16)
+        {
+            std::string bytes = "    ";
+            for (size_t column = index; column < index + 16 && column < m_rom.size(); column++)
+            {
+                char text[8];
+                std::snprintf(text, sizeof(text), "0x%02X, ", m_rom[column]);
+                bytes += text;
+            }
+            bytes.pop_back();
+            line(bytes);
+        }
+        line("};");
+        line("");
+        line("extern const uint32_t " + name + "_rom_size = " + std::to_string(m_rom.size()) + ";");
+        line("");
+        line("extern const QuirkProfile " + name + "_quirk_profile = StaticProgram<Program>::Profile;");
+        line("");
+        line("void " + name + "_run(Machine& machine, uint64_t slice_end)");
+        line("{");
+        line("    StaticProgram<Program>::run(machine, slice_end);");
+        line("}");
+
+        return m_output;
+    }
+
+private:
+    const std::vector<uint8_t>& m_rom;
+    const QuirkProfile m_profile;
+    const uint32_t m_end;
+    std::string m_output;
+    std::vector<bool> m_targets;
+    int m_indent = 0;
+
+    uint16_t word(uint32_t address) const
+    {
+        return m_rom[address - Machine::ResetVector] << 8 | m_rom[address - Machine::ResetVector + 1];
+    }
+
+    void line(const std::string& text)
+    {
+        m_output += text;
+        m_output += '\n';
+    }
+
+    void code(const char* format, ...);
+
+    bool has_label(uint32_t address) const
+    {
+        return !(address & 1) && address >= Machine::ResetVector && address + 1 < m_end && m_targets[address];
+    }
+
+    // Continue at a target known at translation time
+    void jump(uint32_t address)
+    {
+        if (has_label(address))
+            code("goto %s;", label(address).c_str());
+        else
+            code("continue;");
+    }
+
+    void translate_instruction(uint16_t address)
+    {
+        const uint16_t value = word(address);
+        const uint16_t next = address + 2;
+        const uint8_t x = (value >> 8) & 0x0F;
+        const uint8_t y = (value >> 4) & 0x0F;
+        const uint8_t n = value & 0x0F;
+        const uint8_t kk = value & 0xFF;
+        const uint16_t nnn = value & 0x0FFF;
+
+        line("            case 0x" + hex(address) + ":");
+        if (m_targets[address])
+            line("            " + label(address) + ":");
+        // PC already holds the address of the case on every path into it
+        code("if (m.m_cycles >= slice_end) return;");
+        code("if (m.read_word(0x%03X) != 0x%04X) goto interpret;", address, value);
+        code("m.m_cycles++;");
+        code("r.PC = 0x%03X;", next);
+
+        switch (value >> 12)
+        {
+        case 0x0:
+            if (value == 0x00E0)
+            {
+                code("m.op_00e0();");
+            }
+            else if (value == 0x00EE)
+            {
+                code("m.op_00ee();");
+                code("continue;");
+            }
+            break;
+
+        case 0x1:
+            code("r.PC = 0x%03X;", nnn);
+            jump(nnn);
+            break;
+
+        case 0x2:
+            code("m.op_2nnn(0x%03X);", nnn);
+            jump(nnn);
+            break;
+
+        case 0x3: skip("m.op_3xkk(%u, 0x%02X);", next, x, kk); break;
+        case 0x4: skip("m.op_4xkk(%u, 0x%02X);", next, x, kk); break;
+        case 0x5: skip("m.op_5xy0(%u, %u);", next, x, y); break;
+        case 0x6: code("m.op_6xkk(%u, 0x%02X);", x, kk); break;
+        case 0x7: code("m.op_7xkk(%u, 0x%02X);", x, kk); break;
+
+        case 0x8:
+            switch (n)
+            {
+            case 0x0: code("m.op_8xy0(%u, %u);", x, y); break;
+            case 0x1: code("m.op_8xy1<Profile>(%u, %u);", x, y); break;
+            case 0x2: code("m.op_8xy2<Profile>(%u, %u);", x, y); break;
+            case 0x3: code("m.op_8xy3<Profile>(%u, %u);", x, y); break;
+            case 0x4: code("m.op_8xy4(%u, %u);", x, y); break;
+            case 0x5: code("m.op_8xy5(%u, %u);", x, y); break;
+            case 0x6: code("m.op_8xy6<Profile>(%u, %u);", x, y); break;
+            case 0x7: code("m.op_8xy7(%u, %u);", x, y); break;
+            case 0xE: code("m.op_8xye<Profile>(%u, %u);", x, y); break;
+            }
+            break;
+
+        case 0x9: skip("m.op_9xy0(%u, %u);", next, x, y); break;
+        case 0xA: code("m.op_annn(0x%03X);", nnn); break;
+
+        case 0xB:
+            code("m.op_bnnn<Profile>(0x%03X);", nnn);
+            code("continue;");
+            break;
+
+        case 0xC: code("m.op_cxkk(%u, 0x%02X);", x, kk); break;
+        case 0xD:
+            code("m.op_dxyn<Profile>(%u, %u, %u);", x, y, n);
+            if (quirks::of(m_profile).display_wait)
+                code("m.m_cycles = slice_end; return;");
+            break;
+
+        case 0xE:
+            switch (kk)
+            {
+            case 0x9E: skip("m.op_ex9e(%u);", next, x); break;
+            case 0xA1: skip("m.op_exa1(%u);", next, x); break;
+            }
+            break;
+
+        case 0xF:
+            switch (kk)
+            {
+            case 0x07: code("m.op_fx07(%u);", x); break;
+
+            case 0x0A:
+                code("m.op_fx0a(%u);", x);
+                code("if (m.m_waiting_for_key) { m.m_cycles = slice_end; return; }");
+                break;
+
+            case 0x15: code("m.op_fx15(%u);", x); break;
+            case 0x18: code("m.op_fx18(%u);", x); break;
+            case 0x1E: code("m.op_fx1e(%u);", x); break;
+            case 0x29: code("m.op_fx29(%u);", x); break;
+            case 0x33: code("m.op_fx33(%u);", x); break;
+            case 0x55: code("m.op_fx55<Profile>(%u);", x); break;
+            case 0x65: code("m.op_fx65<Profile>(%u);", x); break;
+            }
+            break;
+        }
+
+        // The last instruction falls through to the interpreter at the next address
+        code("[[fallthrough]];");
+    }
+
+    template <typename... Args>
+    void skip(const char* format, uint16_t next, Args... args)
+    {
+        code(format, args...);
+        code("if (r.PC != 0x%03X)", next);
+        m_indent++;
+        jump(next + 2);
+        m_indent--;
+    }
+
+    static std::string hex(uint16_t value)
+    {
+        char text[8];
+        std::snprintf(text, sizeof(text), "%03X", value);
+        return text;
+    }
+};
+
+void Translator::code(const char* format, ...)
+{
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    line(std::string(16 + m_indent * 4, ' ') + text);
+}
+
+int main(int argc, char *argv[])
+{
+    QuirkProfile profile = QuirkProfile::Modern;
+    int first = 1;
+    if (argc > 2 && std::strcmp(argv[1], "--quirks") == 0)
+    {
+        if (!quirks::from_name(argv[2], profile))
+        {
+            std::fprintf(stderr, "Unknown quirk profile %s\n", argv[2]);
+            return -1;
+        }
+        first = 3;
+    }
+
+    if (argc - first < 2)
+    {
+        std::fprintf(stderr, "Usage: %s [--quirks modern|vip|schip|xochip] rom_file output_file [name]\n", argv[0]);
+        return -1;
+    }
+
+    // "-" translates the built-in workload of chip8_bench
+    std::vector<uint8_t> rom(bench_rom, bench_rom + sizeof(bench_rom));
+    if (std::strcmp(argv[first], "-") != 0 && !utils::read_file(argv[first], rom))
+    {
+        std::fprintf(stderr, "Cannot read ROM from file %s\n", argv[first]);
+        return -1;
+    }
+
+    if (rom.empty() || (Machine::MemorySize - Machine::ResetVector) < rom.size())
+    {
+        std::fprintf(stderr, "Invalid ROM size\n");
+        return -1;
+    }
+
+    const std::string name = argc - first > 2 ? argv[first + 2] : "chip8_static";
+    const std::string output = Translator(rom, profile).translate(name);
+
+    FILE* file = std::fopen(argv[first + 1], "w");
+    if (!file)
+    {
+        std::fprintf(stderr, "Cannot write %s\n", argv[first + 1]);
+        return -1;
+    }
+
+    std::fwrite(output.data(), 1, output.size(), file);
+    std::fclose(file);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "machine.hpp"
+#include "movie.hpp"
+#include "utils.hpp"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Replays a movie headless and checks the state hash after every frame, the
+// run is also timed so that recorded gameplay can be used as a benchmark.
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        std::fprintf(stderr, "Usage: chip8_replay rom_file movie_file [switch|cached|threaded|table|jit]\n");
+        return -1;
+    }
+
+    std::vector<uint8_t> rom;
+    if (!utils::read_file(argv[1], rom) || (Machine::MemorySize - Machine::ResetVector) < rom.size())
+    {
+        std::fprintf(stderr, "Cannot read ROM from file %s\n", argv[1]);
+        return -1;
+    }
+
+    Movie movie;
+    if (!movie.load(argv[2]))
+    {
+        std::fprintf(stderr, "Cannot read movie from file %s\n", argv[2]);
+        return -1;
+    }
+
+    if (movie.rom_hash != Movie::hash_rom(rom.data(), (uint32_t)rom.size()))
+    {
+        std::fprintf(stderr, "The movie was recorded with another ROM\n");
+        return -1;
+    }
+
+    Machine::Engine engine = Machine::Engine::Cached;
+    if (argc > 3 && !Machine::engine_from_name(argv[3], engine))
+    {
+        std::fprintf(stderr, "Unknown engine %s\n", argv[3]);
+        return -1;
+    }
+
+    MovieInput input(movie);
+    Machine machine;
+    machine.set_engine(engine);
+    machine.set_input(&input);
+    machine.set_seed(movie.seed);
+    machine.set_instructions_per_second(movie.instructions_per_second);
+    machine.set_quirk_profile(movie.quirk_profile);
+    machine.set_idle_skip(true);
+    machine.load_rom(rom.data(), (uint32_t)rom.size());
+
+    // Only the emulation is timed, not the hash checks
+    double elapsed = 0.0;
+    for (uint32_t frame = 0; frame < movie.frame_count(); frame++)
+    {
+        input.set_frame(frame);
+
+        auto start = std::chrono::steady_clock::now();
+        machine.run_frame();
+        elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (machine.hash() != movie.hashes[frame])
+        {
+            std::fprintf(stderr, "Desync at frame %u\n", frame);
+            return 1;
+        }
+    }
+
+    std::printf("%u frames match, %u key events, %.3f s, %.2f MIPS\n",
+        movie.frame_count(),
+        (uint32_t)movie.events.size(),
+        elapsed,
+        machine.cycles() / elapsed / 1000000.0);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "machine.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Defined by the C++ file emitted by chip8_recompile
+extern const uint8_t chip8_static_rom[];
+extern const uint32_t chip8_static_rom_size;
+extern const QuirkProfile chip8_static_quirk_profile;
+void chip8_static_run(Machine& machine, uint64_t slice_end);
+
+// A positive decimal number, nothing else
+static bool parse_count(const char* text, uint32_t& value)
+{
+    char* end = nullptr;
+    const unsigned long parsed = std::strtoul(text, &end, 10);
+    if (end == text || *end != '\0' || parsed == 0 || parsed > UINT32_MAX)
+        return false;
+
+    value = (uint32_t)parsed;
+    return true;
+}
+
+// Run the translated ROM headless next to the cached interpreter and compare
+// the machine state hashes after every frame, then time both engines.
+int main(int argc, char *argv[])
+{
+    uint32_t frames = 600;
+    uint32_t instructions_per_second = Machine::DefaultInstructionsPerSecond;
+
+    if (argc > 3 ||
+        (argc > 1 && !parse_count(argv[1], frames)) ||
+        (argc > 2 && !parse_count(argv[2], instructions_per_second)))
+    {
+        std::fprintf(stderr, "Usage: %s [frames] [instructions_per_second]\n", argv[0]);
+        return -1;
+    }
+
+    Machine machines[2];
+    machines[0].set_engine(Machine::Engine::Cached);
+    machines[1].set_engine(Machine::Engine::Static);
+    machines[1].set_static_runner(&chip8_static_run);
+
+    double elapsed[2] = { 0.0, 0.0 };
+    for (int index = 0; index < 2; index++)
+    {
+        machines[index].set_instructions_per_second(instructions_per_second);
+        machines[index].set_quirk_profile(chip8_static_quirk_profile);
+        machines[index].load_rom(chip8_static_rom, chip8_static_rom_size);
+    }
+
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        for (int index = 0; index < 2; index++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            machines[index].run_frame();
+            elapsed[index] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        if (machines[0].hash() != machines[1].hash())
+        {
+            std::fprintf(stderr, "State mismatch at frame %u\n", frame);
+            return 1;
+        }
+    }
+
+    std::printf("%u frames match, cached %.3f s, static %.3f s, x%.2f\n",
+        frames, elapsed[0], elapsed[1], elapsed[1] > 0.0 ? elapsed[0] / elapsed[1] : 0.0);
+    return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest value from one producer thread to one consumer thread
+// without locks or waiting. The producer fills its back slot and swaps it with
+// the middle one, the consumer swaps the middle slot with its front one when
+// the middle holds a value it has not seen. Values the consumer is too slow to
+// take are dropped, a back slot holds an old value and has to be fully written.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Producer side
+    T& back() { return m_slots[m_back]; }
+
+    void publish()
+    {
+        m_back = m_middle.exchange(m_back | NewValue, std::memory_order_acq_rel) & SlotMask;
+    }
+
+    // Consumer side, takes the newest value, false when nothing new was published
+    bool update()
+    {
+        if ((m_middle.load(std::memory_order_relaxed) & NewValue) == 0)
+            return false;
+
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & SlotMask;
+        return true;
+    }
+
+    const T& front() const { return m_slots[m_front]; }
+
+private:
+    static inline constexpr uint32_t SlotMask = 3;
+    static inline constexpr uint32_t NewValue = 4;
+
+    T m_slots[3] {};
+    alignas(64) std::atomic<uint32_t> m_middle { 1 };
+    alignas(64) uint32_t m_back = 0;
+    alignas(64) uint32_t m_front = 2;
+};
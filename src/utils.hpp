@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
+#include <fstream>
 #include <filesystem>
 
 namespace utils
@@ -12,4 +15,28 @@ inline uint32_t get_file_size(const std::string& file_path)
     return std::filesystem::file_size(path);
 }
 
+inline bool read_file(const std::string& file_path, std::vector<uint8_t>& data)
+{
+    std::ifstream file(file_path, std::ifstream::binary);
+    if (!file.is_open())
+        return false;
+
+    std::error_code error;
+    auto size = std::filesystem::file_size(std::filesystem::path { file_path }, error);
+    if (error)
+        return false;
+
+    data.resize(size);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(data.data()), size));
+}
+
+inline bool write_file(const std::string& file_path, const uint8_t* data, size_t size)
+{
+    std::ofstream file(file_path, std::ofstream::binary);
+    if (!file.is_open())
+        return false;
+
+    return static_cast<bool>(file.write(reinterpret_cast<const char*>(data), size));
+}
+
 } // namespace utils